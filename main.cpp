@@ -1,14 +1,50 @@
 #include "httplib.h"
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
+#include <array>
+#include <unordered_map>
+#include <unordered_set>
+#include <iterator>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+#include <limits>
 #include <mutex>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <map>
+#include <set>
+#include <functional>
+#include <memory>
 #include <fstream>
+#include <sstream>
 #include <algorithm>
 #include <random>
 #include <chrono>
 #include <ctime>
 #include <iomanip>
+#include <thread>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <charconv>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #include "nlohmann/json.hpp"
 
 // For convenience
@@ -17,9 +53,245 @@ using json = nlohmann::json;
 // Global mutex for thread-safe file operations
 std::mutex g_file_mutex;
 
-// Data file path
+// Serializes snapshot compactions (background and /admin/save-data) and
+// JSON imports/exports
+std::mutex g_compact_mutex;
+
+// JSON data file, used for import/export and to migrate data written before
+// the binary snapshot existed
 const std::string DATA_FILE = "bin_data.json";
 
+// Binary snapshot written by compaction and preferred at startup
+const std::string SNAPSHOT_FILE = "bin_data.snapshot";
+
+// Mapped bin table used instead of the snapshot and journal when
+// SMWS_STORAGE=mmap
+const std::string TABLE_FILE = "bin_data.table";
+
+// Journal file prefix (mutations appended since the last full snapshot).
+// Shard k appends to JOURNAL_FILE.k; a segment being folded into a snapshot
+// by an in-progress compaction is renamed to JOURNAL_FILE.k.compacting.
+const std::string JOURNAL_FILE = "bin_data.journal";
+
+// Helpers: Append JSON tokens straight into an output buffer. Output matches
+// nlohmann::json::dump() byte for byte (no whitespace, same escaping), so
+// responses can be written without building a json tree first.
+void appendJsonString(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    size_t run = 0;  // Start of the pending run of bytes needing no escape
+    for (size_t i = 0; i < value.size(); ++i) {
+        const unsigned char c = static_cast<unsigned char>(value[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') {
+            continue;
+        }
+        out.append(value.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+                break;
+        }
+    }
+    out.append(value.data() + run, value.size() - run);
+    out += '"';
+}
+
+template <typename Int>
+void appendJsonInt(std::string& out, Int value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+void appendJsonBool(std::string& out, bool value) {
+    out += value ? "true" : "false";
+}
+
+// Helpers: Timestamps are stored as milliseconds since the Unix epoch and
+// exchanged as ISO 8601 UTC strings ("2024-01-31T12:00:00.000Z")
+int64_t currentTimeMillis() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Length of a formatted timestamp ("2024-01-31T12:00:00.000Z")
+constexpr size_t TIMESTAMP_LENGTH = 24;
+
+// Write the ISO 8601 form of millis into out[0, TIMESTAMP_LENGTH). No
+// allocation, no locale and no gmtime: the "YYYY-MM-DDTHH:MM:SS" prefix is
+// computed from the day number and cached per thread for the current second,
+// so bins stamped in the same second only render their milliseconds.
+void formatTimestamp(int64_t millis, char* out) {
+    struct PrefixCache {
+        int64_t second = INT64_MIN;
+        char prefix[19];
+    };
+    thread_local PrefixCache cache;
+
+    int64_t second = millis / 1000;
+    int64_t ms = millis % 1000;
+    if (ms < 0) {
+        ms += 1000;
+        second -= 1;
+    }
+
+    if (second != cache.second) {
+        int64_t days = second / 86400;
+        int64_t secondOfDay = second % 86400;
+        if (secondOfDay < 0) {
+            secondOfDay += 86400;
+            days -= 1;
+        }
+
+        // Civil date from days since 1970-01-01 (proleptic Gregorian)
+        const int64_t z = days + 719468;
+        const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        const int64_t doe = z - era * 146097;
+        const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const int64_t mp = (5 * doy + 2) / 153;
+        const int64_t day = doy - (153 * mp + 2) / 5 + 1;
+        const int64_t month = mp < 10 ? mp + 3 : mp - 9;
+        const int64_t year = yoe + era * 400 + (month <= 2 ? 1 : 0);
+
+        auto put = [](char* at, int64_t value, int width) {
+            for (int i = width - 1; i >= 0; i--) {
+                at[i] = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+        };
+        char* p = cache.prefix;
+        put(p, year, 4);
+        p[4] = '-';
+        put(p + 5, month, 2);
+        p[7] = '-';
+        put(p + 8, day, 2);
+        p[10] = 'T';
+        put(p + 11, secondOfDay / 3600, 2);
+        p[13] = ':';
+        put(p + 14, secondOfDay / 60 % 60, 2);
+        p[16] = ':';
+        put(p + 17, secondOfDay % 60, 2);
+        cache.second = second;
+    }
+
+    std::memcpy(out, cache.prefix, sizeof(cache.prefix));
+    out[19] = '.';
+    out[20] = static_cast<char>('0' + ms / 100);
+    out[21] = static_cast<char>('0' + ms / 10 % 10);
+    out[22] = static_cast<char>('0' + ms % 10);
+    out[23] = 'Z';
+}
+
+std::string formatTimestamp(int64_t millis) {
+    char text[TIMESTAMP_LENGTH];
+    formatTimestamp(millis, text);
+    return std::string(text, TIMESTAMP_LENGTH);
+}
+
+// Append a timestamp as a JSON string (it never needs escaping)
+void appendJsonTimestamp(std::string& out, int64_t millis) {
+    char text[TIMESTAMP_LENGTH + 2];
+    text[0] = '"';
+    formatTimestamp(millis, text + 1);
+    text[TIMESTAMP_LENGTH + 1] = '"';
+    out.append(text, sizeof(text));
+}
+
+// Accepts a date with optional time, fraction and zone, either Z or a UTC
+// offset ("2024-01-31", "2024-01-31T12:00:00", "2024-01-31T12:00:00.5Z",
+// "2024-01-31T14:00:00+02:00", "2024-01-31T07:00:00-0500")
+bool parseTimestamp(const std::string& text, int64_t& millis) {
+    std::tm utc = {};
+    int consumed = 0;
+    if (std::sscanf(text.c_str(), "%4d-%2d-%2d%n", &utc.tm_year, &utc.tm_mon, &utc.tm_mday, &consumed) != 3) {
+        return false;
+    }
+
+    const char* rest = text.c_str() + consumed;
+    int fraction = 0;
+    if (*rest == 'T') {
+        int timeConsumed = 0;
+        if (std::sscanf(rest, "T%2d:%2d:%2d%n", &utc.tm_hour, &utc.tm_min, &utc.tm_sec, &timeConsumed) != 3) {
+            return false;
+        }
+        rest += timeConsumed;
+        if (*rest == '.') {
+            int digits = 0;
+            for (++rest; *rest >= '0' && *rest <= '9'; ++rest, ++digits) {
+                if (digits < 3) {
+                    fraction = fraction * 10 + (*rest - '0');
+                }
+            }
+            if (digits == 0) {
+                return false;
+            }
+            for (; digits < 3; ++digits) {
+                fraction *= 10;
+            }
+        }
+    }
+    int offsetMinutes = 0;
+    if (*rest == 'Z') {
+        ++rest;
+    } else if ((*rest == '+' || *rest == '-') && text.find('T') != std::string::npos) {
+        // UTC offset: +HH:MM, +HHMM or +HH
+        const int sign = *rest++ == '-' ? -1 : 1;
+        auto twoDigits = [&rest](int& value) {
+            if (rest[0] < '0' || rest[0] > '9' || rest[1] < '0' || rest[1] > '9') {
+                return false;
+            }
+            value = (rest[0] - '0') * 10 + (rest[1] - '0');
+            rest += 2;
+            return true;
+        };
+        int hours = 0, minutes = 0;
+        if (!twoDigits(hours)) {
+            return false;
+        }
+        const bool colon = *rest == ':';
+        if (colon) {
+            ++rest;
+        }
+        if ((colon || *rest != '\0') && !twoDigits(minutes)) {
+            return false;
+        }
+        if (hours > 23 || minutes > 59) {
+            return false;
+        }
+        offsetMinutes = sign * (hours * 60 + minutes);
+    }
+    if (*rest != '\0' || utc.tm_mon < 1 || utc.tm_mon > 12 || utc.tm_mday < 1 || utc.tm_mday > 31 ||
+        utc.tm_hour > 23 || utc.tm_min > 59 || utc.tm_sec > 60) {
+        return false;
+    }
+
+    utc.tm_year -= 1900;
+    utc.tm_mon -= 1;
+    millis = (static_cast<int64_t>(timegm(&utc)) - offsetMinutes * 60) * 1000 + fraction;
+    return true;
+}
+
+// Helper: Parse a stored timestamp; throws if it is not one parseTimestamp()
+// accepts, so a damaged value is never silently read as the epoch
+int64_t requireTimestamp(const std::string& text) {
+    int64_t millis;
+    if (!parseTimestamp(text, millis)) {
+        throw std::runtime_error("invalid timestamp '" + text + "'");
+    }
+    return millis;
+}
+
 // WasteBin class
 class WasteBin {
 public:
@@ -27,17 +299,17 @@ public:
     std::string location;
     int fillLevel;
     bool needsCollection;
-    std::string lastUpdated;
+    int64_t lastUpdated;  // Milliseconds since the epoch; ISO 8601 in JSON
 
     // Default constructor
     WasteBin() : id(0), location(""), fillLevel(0), needsCollection(false) {
-        lastUpdated = getCurrentTimestamp();
+        lastUpdated = currentTimeMillis();
     }
 
     // Constructor with fields
     WasteBin(int id, const std::string& location, int fillLevel = 0, bool needsCollection = false)
         : id(id), location(location), fillLevel(fillLevel), needsCollection(needsCollection) {
-        lastUpdated = getCurrentTimestamp();
+        lastUpdated = currentTimeMillis();
     }
 
     // Convert to JSON
@@ -47,10 +319,67 @@ public:
             {"location", location},
             {"fillLevel", fillLevel},
             {"needsCollection", needsCollection},
-            {"lastUpdated", lastUpdated}
+            {"lastUpdated", formatTimestamp(lastUpdated)}
         };
     }
 
+    // Fields selectable for appendJson
+    enum Field : unsigned {
+        FIELD_ID = 1u << 0,
+        FIELD_LOCATION = 1u << 1,
+        FIELD_FILL_LEVEL = 1u << 2,
+        FIELD_NEEDS_COLLECTION = 1u << 3,
+        FIELD_LAST_UPDATED = 1u << 4,
+        ALL_FIELDS = (1u << 5) - 1
+    };
+
+    // Append the same bytes as toJson().dump() (restricted to the given
+    // fields), without building the json object. Keys are in the sorted
+    // order nlohmann::json uses.
+    void appendJson(std::string& out, unsigned fields = ALL_FIELDS) const {
+        appendJson(out, fields, id, location, fillLevel, needsCollection, lastUpdated);
+    }
+
+    // Same, from the attributes of a bin stored elsewhere
+    static void appendJson(std::string& out, unsigned fields, int id, std::string_view location,
+                           int fillLevel, bool needsCollection, int64_t lastUpdated) {
+        char sep = '{';
+        if (fields & FIELD_FILL_LEVEL) {
+            out += sep;
+            out += "\"fillLevel\":";
+            appendJsonInt(out, fillLevel);
+            sep = ',';
+        }
+        if (fields & FIELD_ID) {
+            out += sep;
+            out += "\"id\":";
+            appendJsonInt(out, id);
+            sep = ',';
+        }
+        if (fields & FIELD_LAST_UPDATED) {
+            out += sep;
+            out += "\"lastUpdated\":";
+            appendJsonTimestamp(out, lastUpdated);
+            sep = ',';
+        }
+        if (fields & FIELD_LOCATION) {
+            out += sep;
+            out += "\"location\":";
+            appendJsonString(out, location);
+            sep = ',';
+        }
+        if (fields & FIELD_NEEDS_COLLECTION) {
+            out += sep;
+            out += "\"needsCollection\":";
+            appendJsonBool(out, needsCollection);
+            sep = ',';
+        }
+        if (sep == '{') {
+            out += '{';
+        }
+        out += '}';
+    }
+
     // Create from JSON
     static WasteBin fromJson(const json& j) {
         WasteBin bin;
@@ -58,99 +387,7100 @@ public:
         bin.location = j.at("location").get<std::string>();
         bin.fillLevel = j.at("fillLevel").get<int>();
         bin.needsCollection = j.at("needsCollection").get<bool>();
-        bin.lastUpdated = j.at("lastUpdated").get<std::string>();
+        bin.lastUpdated = requireTimestamp(j.at("lastUpdated").get<std::string>());
         return bin;
     }
+};
 
-private:
-    // Get current time as ISO string
-    static std::string getCurrentTimestamp() {
-        auto now = std::chrono::system_clock::now();
-        auto now_c = std::chrono::system_clock::to_time_t(now);
-        auto now_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-            now.time_since_epoch()) % 1000;
+// Interned location strings. Each distinct location is copied once into an
+// append-only arena and bins store its 32-bit handle, so equal locations
+// share their bytes and compare by handle. Handle 0 is the empty string.
+//
+// Interning takes a mutex. Resolving a handle is lock-free: arena blocks and
+// entry segments never move once written, and a handle only reaches readers
+// through a published shard version, which orders it after the write.
+class LocationPool {
+    static constexpr size_t BLOCK_BYTES = 64 * 1024;
+    static constexpr size_t SEGMENT_BITS = 12;
+    static constexpr size_t SEGMENT_SIZE = size_t(1) << SEGMENT_BITS;
+    static constexpr size_t MAX_SEGMENTS = size_t(1) << 16;
+
+    struct Entry {
+        const char* data;
+        uint32_t length;
+    };
+
+public:
+    // Byte counts for the memory accounting endpoint
+    struct Usage {
+        size_t uniqueStrings = 0;
+        size_t stringBytes = 0;   // Bytes of distinct location text
+        size_t arenaBytes = 0;    // Bytes reserved by arena blocks
+        size_t indexBytes = 0;    // Entry segments plus the dedup index (estimated)
+    };
+
+    LocationPool() : segments_(new std::atomic<Entry*>[MAX_SEGMENTS]) {
+        for (size_t i = 0; i < MAX_SEGMENTS; i++) {
+            segments_[i].store(nullptr, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        addEntry(std::string_view());
+    }
+
+    ~LocationPool() {
+        for (size_t i = 0; i < MAX_SEGMENTS; i++) {
+            delete[] segments_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    LocationPool(const LocationPool&) = delete;
+    LocationPool& operator=(const LocationPool&) = delete;
+
+    uint32_t intern(std::string_view text) {
+        if (text.empty()) {
+            return 0;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(text);
+        if (it != index_.end()) {
+            return it->second;
+        }
+
+        if (text.size() > BLOCK_BYTES / 4) {
+            // Long strings get a block of their own instead of wasting the tail
+            blocks_.emplace_back(new char[text.size()]);
+            arenaBytes_ += text.size();
+            std::memcpy(blocks_.back().get(), text.data(), text.size());
+            return addEntry(std::string_view(blocks_.back().get(), text.size()));
+        }
 
-        std::stringstream ss;
-        ss << std::put_time(std::gmtime(&now_c), "%Y-%m-%dT%H:%M:%S");
-        ss << '.' << std::setfill('0') << std::setw(3) << now_ms.count();
-        ss << "Z";
-        return ss.str();
+        if (blocks_.empty() || blockUsed_ + text.size() > BLOCK_BYTES) {
+            blocks_.emplace_back(new char[BLOCK_BYTES]);
+            currentBlock_ = blocks_.back().get();
+            arenaBytes_ += BLOCK_BYTES;
+            blockUsed_ = 0;
+        }
+        char* at = currentBlock_ + blockUsed_;
+        std::memcpy(at, text.data(), text.size());
+        blockUsed_ += text.size();
+        return addEntry(std::string_view(at, text.size()));
+    }
+
+    std::string_view view(uint32_t handle) const {
+        const Entry* segment = segments_[handle >> SEGMENT_BITS].load(std::memory_order_acquire);
+        const Entry& entry = segment[handle & (SEGMENT_SIZE - 1)];
+        return std::string_view(entry.data, entry.length);
+    }
+
+    Usage usage() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Usage result;
+        result.uniqueStrings = count_ - 1;  // Not counting the empty string
+        result.stringBytes = stringBytes_;
+        result.arenaBytes = arenaBytes_;
+        result.indexBytes = ((count_ + SEGMENT_SIZE - 1) / SEGMENT_SIZE) * SEGMENT_SIZE * sizeof(Entry) +
+                            index_.size() * (sizeof(std::string_view) + sizeof(uint32_t) + 2 * sizeof(void*)) +
+                            index_.bucket_count() * sizeof(void*);
+        return result;
+    }
+
+private:
+    // Caller holds mutex_
+    uint32_t addEntry(std::string_view text) {
+        if (count_ == SEGMENT_SIZE * MAX_SEGMENTS) {
+            throw std::length_error("location pool is full");
+        }
+        const uint32_t handle = static_cast<uint32_t>(count_);
+        std::atomic<Entry*>& slot = segments_[handle >> SEGMENT_BITS];
+        Entry* segment = slot.load(std::memory_order_relaxed);
+        if (segment == nullptr) {
+            segment = new Entry[SEGMENT_SIZE];
+            slot.store(segment, std::memory_order_release);
+        }
+        segment[handle & (SEGMENT_SIZE - 1)] = Entry{text.data(), static_cast<uint32_t>(text.size())};
+        if (!text.empty()) {
+            index_.emplace(text, handle);
+        }
+        stringBytes_ += text.size();
+        count_++;
+        return handle;
     }
+
+    mutable std::mutex mutex_;
+    std::unique_ptr<std::atomic<Entry*>[]> segments_;
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* currentBlock_ = nullptr;
+    size_t blockUsed_ = 0;
+    size_t count_ = 0;
+    size_t stringBytes_ = 0;
+    size_t arenaBytes_ = 0;
+    std::unordered_map<std::string_view, uint32_t> index_;
 };
 
-// Global variables
-std::vector<WasteBin> g_bins;
-int g_next_bin_id = 1;
+// Shared by every table, so a location is stored once however many bins,
+// pages and versions refer to it
+LocationPool g_locations;
+
+// Slot map of bins stored column by column (structure of arrays): ids, uint8
+// fill levels, packed needsCollection and live bitsets, int64 timestamps and
+// interned location handles (see LocationPool). Scans that only need one
+// attribute touch one dense column instead of whole bins.
+//
+// An id -> slot hash index gives O(1) lookup, update and delete; freed slots
+// are chained on a free list and reused by later inserts. Slots are also
+// threaded on a doubly linked list in insertion order, which is the order
+// iteration exposes. Row and RowRef are views of one slot for the handlers;
+// WasteBin stays the value type bins are created from and exported as.
+//
+// Each slot also caches the bin's serialized JSON. Every RowRef setter marks
+// it stale; refreshFragments() re-renders the stale ones, so list responses
+// mostly copy cached bytes.
+class BinTable {
+    static constexpr uint32_t NIL = UINT32_MAX;
+
+public:
+    // Read-only view of one bin
+    class Row {
+    public:
+        Row() = default;
+        Row(const BinTable* table, uint32_t slot) : table_(table), slot_(slot) {}
+
+        explicit operator bool() const { return table_ != nullptr; }
+
+        int id() const { return table_->ids_[slot_]; }
+        int fillLevel() const { return table_->fill_[slot_]; }
+        bool needsCollection() const { return testBit(table_->collect_, slot_); }
+        int64_t lastUpdatedMs() const { return table_->updated_[slot_]; }
+        std::string lastUpdated() const { return formatTimestamp(lastUpdatedMs()); }
+        std::string_view location() const { return g_locations.view(locationHandle()); }
+        uint32_t locationHandle() const { return table_->locations_[slot_]; }
+
+        // Cached serialization of the bin, or nullptr if it changed since the
+        // table's fragments were last refreshed
+        const std::string* fragment() const {
+            return table_->stale_[slot_] ? nullptr : &table_->fragments_[slot_];
+        }
+
+        // Same bytes as toBin().appendJson(out, fields)
+        void appendJson(std::string& out, unsigned fields = WasteBin::ALL_FIELDS) const {
+            if (fields == WasteBin::ALL_FIELDS && !table_->stale_[slot_]) {
+                out += table_->fragments_[slot_];
+                return;
+            }
+            WasteBin::appendJson(out, fields, id(), location(), fillLevel(), needsCollection(), lastUpdatedMs());
+        }
+
+        WasteBin toBin() const {
+            WasteBin bin(id(), std::string(location()), fillLevel(), needsCollection());
+            bin.lastUpdated = lastUpdatedMs();
+            return bin;
+        }
+
+    protected:
+        const BinTable* table_ = nullptr;
+        uint32_t slot_ = 0;
+    };
+
+    // Mutable view of one bin; setters keep the columns and the cached
+    // fragment in step. Like a pointer into the table, it is invalidated by
+    // inserting into the table.
+    class RowRef : public Row {
+    public:
+        RowRef() = default;
+        RowRef(BinTable* table, uint32_t slot) : Row(table, slot) {}
+
+        void setFillLevel(int fillLevel) {
+            table().fill_[slot_] = clampFill(fillLevel);
+            table().stale_[slot_] = 1;
+        }
+
+        void setNeedsCollection(bool needsCollection) {
+            setBit(table().collect_, slot_, needsCollection);
+            table().stale_[slot_] = 1;
+        }
+
+        void setLastUpdated(int64_t millis) {
+            table().updated_[slot_] = millis;
+            table().stale_[slot_] = 1;
+        }
+
+        void setLocation(std::string_view location) {
+            setLocationHandle(g_locations.intern(location));
+        }
+
+        void setLocationHandle(uint32_t handle) {
+            if (table().locations_[slot_] != handle) {
+                table().locations_[slot_] = handle;
+                table().stale_[slot_] = 1;
+            }
+        }
 
-// Helper: Create standard API response JSON
-json createApiResponse(bool success, const std::string& message, const json& data = nullptr) {
-    json response = {
-        {"success", success},
-        {"message", message}
+    private:
+        BinTable& table() const { return const_cast<BinTable&>(*table_); }
     };
 
-    if (!data.is_null()) {
-        response["data"] = data;
+    template <typename TablePtr, typename RowType>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = RowType;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = RowType;
+
+        Iterator(TablePtr table, uint32_t slot) : table_(table), slot_(slot) {}
+
+        RowType operator*() const { return RowType(table_, slot_); }
+        Iterator& operator++() { slot_ = table_->next_[slot_]; return *this; }
+        bool operator==(const Iterator& other) const { return slot_ == other.slot_; }
+        bool operator!=(const Iterator& other) const { return slot_ != other.slot_; }
+
+    private:
+        TablePtr table_;
+        uint32_t slot_;
+    };
+
+    using iterator = Iterator<BinTable*, RowRef>;
+    using const_iterator = Iterator<const BinTable*, Row>;
+
+    iterator begin() { return iterator(this, head_); }
+    iterator end() { return iterator(this, NIL); }
+    const_iterator begin() const { return const_iterator(this, head_); }
+    const_iterator end() const { return const_iterator(this, NIL); }
+
+    size_t size() const { return index_.size(); }
+    bool empty() const { return index_.empty(); }
+
+    Row find(int id) const {
+        auto it = index_.find(id);
+        return it == index_.end() ? Row() : Row(this, it->second);
+    }
+
+    RowRef find(int id) {
+        auto it = index_.find(id);
+        return it == index_.end() ? RowRef() : RowRef(this, it->second);
+    }
+
+    // Append a bin at the end of the insertion order; a bin with the same id
+    // is replaced in place and keeps its position
+    RowRef insert(const WasteBin& bin) {
+        RowRef row = slotFor(bin.id);
+        row.setLocation(bin.location);
+        row.setFillLevel(bin.fillLevel);
+        row.setNeedsCollection(bin.needsCollection);
+        row.setLastUpdated(bin.lastUpdated);
+        return row;
+    }
+
+    // Same, copying the columns of a bin from another table
+    RowRef insert(const Row& bin) {
+        return insert(bin.id(), bin.locationHandle(), bin.fillLevel(), bin.needsCollection(), bin.lastUpdatedMs());
+    }
+
+    // Same, from raw column values
+    RowRef insert(int id, uint32_t locationHandle, int fillLevel, bool needsCollection, int64_t lastUpdated) {
+        RowRef row = slotFor(id);
+        row.setLocationHandle(locationHandle);
+        row.setFillLevel(fillLevel);
+        row.setNeedsCollection(needsCollection);
+        row.setLastUpdated(lastUpdated);
+        return row;
+    }
+
+    bool erase(int id) {
+        auto it = index_.find(id);
+        if (it == index_.end()) {
+            return false;
+        }
+
+        uint32_t slot = it->second;
+        index_.erase(it);
+
+        if (prev_[slot] != NIL) next_[prev_[slot]] = next_[slot]; else head_ = next_[slot];
+        if (next_[slot] != NIL) prev_[next_[slot]] = prev_[slot]; else tail_ = prev_[slot];
+
+        locations_[slot] = 0;
+        ids_[slot] = 0;
+        fill_[slot] = 0;
+        updated_[slot] = 0;
+        setBit(collect_, slot, false);
+        setBit(live_, slot, false);
+        fragments_[slot].clear();
+        stale_[slot] = 1;
+        prev_[slot] = NIL;
+        next_[slot] = freeHead_;
+        freeHead_ = slot;
+        return true;
+    }
+
+    void reserve(size_t count) {
+        ids_.reserve(count);
+        fill_.reserve(count);
+        updated_.reserve(count);
+        locations_.reserve(count);
+        fragments_.reserve(count);
+        stale_.reserve(count);
+        prev_.reserve(count);
+        next_.reserve(count);
+        live_.reserve(bitWords(count));
+        collect_.reserve(bitWords(count));
+        index_.reserve(count);
+    }
+
+    // Re-render the fragment of every bin changed since the last refresh
+    void refreshFragments() {
+        for (uint32_t slot = head_; slot != NIL; slot = next_[slot]) {
+            if (stale_[slot]) {
+                fragments_[slot].clear();
+                Row(this, slot).appendJson(fragments_[slot]);
+                stale_[slot] = 0;
+            }
+        }
+    }
+
+    int maxId() const {
+        int result = 0;
+        for (const auto& entry : index_) {
+            result = std::max(result, entry.first);
+        }
+        return result;
+    }
+
+    // Raw columns for order-free scans. Slots [0, slotCount()) include freed
+    // ones, which have their live bit clear (and fill 0, needsCollection 0).
+    size_t slotCount() const { return ids_.size(); }
+    const uint8_t* fillColumn() const { return fill_.data(); }
+    const uint64_t* liveBits() const { return live_.data(); }
+    const uint64_t* collectBits() const { return collect_.data(); }
+
+private:
+    static size_t bitWords(size_t bits) { return (bits + 63) / 64; }
+
+    static bool testBit(const std::vector<uint64_t>& bits, uint32_t slot) {
+        return (bits[slot / 64] >> (slot % 64)) & 1;
+    }
+
+    static void setBit(std::vector<uint64_t>& bits, uint32_t slot, bool value) {
+        uint64_t mask = uint64_t(1) << (slot % 64);
+        if (value) {
+            bits[slot / 64] |= mask;
+        } else {
+            bits[slot / 64] &= ~mask;
+        }
+    }
+
+    static uint8_t clampFill(int fillLevel) {
+        return static_cast<uint8_t>(std::max(0, std::min(100, fillLevel)));
+    }
+
+    // Slot holding id, appending a new one to the insertion order if needed
+    RowRef slotFor(int id) {
+        auto existing = index_.find(id);
+        if (existing != index_.end()) {
+            return RowRef(this, existing->second);
+        }
+
+        uint32_t slot = allocateSlot();
+        ids_[slot] = id;
+        setBit(live_, slot, true);
+        prev_[slot] = tail_;
+        next_[slot] = NIL;
+        if (tail_ != NIL) {
+            next_[tail_] = slot;
+        } else {
+            head_ = slot;
+        }
+        tail_ = slot;
+        index_.emplace(id, slot);
+        return RowRef(this, slot);
     }
 
-    return response;
+    uint32_t allocateSlot() {
+        if (freeHead_ != NIL) {
+            uint32_t slot = freeHead_;
+            freeHead_ = next_[slot];
+            return slot;
+        }
+
+        uint32_t slot = static_cast<uint32_t>(ids_.size());
+        ids_.push_back(0);
+        fill_.push_back(0);
+        updated_.push_back(0);
+        locations_.push_back(0);
+        fragments_.emplace_back();
+        stale_.push_back(1);
+        prev_.push_back(NIL);
+        next_.push_back(NIL);
+        if (live_.size() < bitWords(slot + 1)) {
+            live_.push_back(0);
+            collect_.push_back(0);
+        }
+        return slot;
+    }
+
+    std::vector<int> ids_;
+    std::vector<uint8_t> fill_;
+    std::vector<uint64_t> live_;
+    std::vector<uint64_t> collect_;
+    std::vector<int64_t> updated_;
+    std::vector<uint32_t> locations_;
+    std::vector<std::string> fragments_;
+    std::vector<uint8_t> stale_;
+    std::vector<uint32_t> prev_;
+    std::vector<uint32_t> next_;
+    std::unordered_map<int, uint32_t> index_;
+    uint32_t head_ = NIL;
+    uint32_t tail_ = NIL;
+    uint32_t freeHead_ = NIL;
+};
+
+// Helper: Create standard API response body {"data","message","success"}.
+// writeData(out) appends the data value; without it the key is omitted.
+void appendApiResponse(std::string& out, bool success, const std::string& message,
+                       const std::function<void(std::string&)>& writeData = nullptr) {
+    out += '{';
+    if (writeData) {
+        out += "\"data\":";
+        writeData(out);
+        out += ',';
+    }
+    out += "\"message\":";
+    appendJsonString(out, message);
+    out += ",\"success\":";
+    appendJsonBool(out, success);
+    out += '}';
 }
 
-// Helper: Load data from file
-void loadBinsFromFile() {
-    std::lock_guard<std::mutex> lock(g_file_mutex);
+std::string createApiResponse(bool success, const std::string& message,
+                              const std::function<void(std::string&)>& writeData = nullptr) {
+    std::string out;
+    appendApiResponse(out, success, message, writeData);
+    return out;
+}
+
+// Helper: Create standard API response body with a json value as data
+std::string createApiResponse(bool success, const std::string& message, const json& data) {
+    return createApiResponse(success, message, [&data](std::string& out) {
+        out += data.dump();
+    });
+}
+
+// Helper: Append a JSON array of bins
+template <typename Bins>
+void appendBinArray(std::string& out, const Bins& bins, unsigned fields = WasteBin::ALL_FIELDS) {
+    out += '[';
+    bool first = true;
+    for (const auto& bin : bins) {
+        if (!first) {
+            out += ',';
+        }
+        first = false;
+        bin.appendJson(out, fields);
+    }
+    out += ']';
+}
+
+// Helper: Read an integer setting from the environment
+int getEnvInt(const char* name, int fallback) {
+    const char* value = std::getenv(name);
+    if (value == nullptr || *value == '\0') {
+        return fallback;
+    }
 
     try {
-        std::ifstream file(DATA_FILE);
-        if (!file.is_open()) {
-            g_bins.clear();
-            g_next_bin_id = 1;
-            return;
+        return std::stoi(value);
+    }
+    catch (const std::exception&) {
+        std::cerr << "Ignoring invalid " << name << "=" << value << std::endl;
+        return fallback;
+    }
+}
+
+// Helper: Read a string setting from the environment
+std::string getEnvString(const char* name, const std::string& fallback) {
+    const char* value = std::getenv(name);
+    return (value == nullptr || *value == '\0') ? fallback : std::string(value);
+}
+
+// Journal record helpers. Each mutation is appended to its shard's journal
+// segment as one compact JSON line: {"op":..., "id":..., "fields":{...}, "ts":...}.
+// "add" carries every field, "update" only the fields that changed and
+// "delete" none. Records hold absolute values, so replaying a record that is
+// already reflected in the snapshot is harmless.
+json makeJournalRecord(const std::string& op, int id, const json& fields, const std::string& ts) {
+    json record = {
+        {"op", op},
+        {"id", id}
+    };
+
+    if (!fields.is_null()) {
+        record["fields"] = fields;
+    }
+    record["ts"] = ts;
+
+    return record;
+}
+
+json journalAddRecord(const WasteBin& bin) {
+    json fields = bin.toJson();
+    fields.erase("id");
+    return makeJournalRecord("add", bin.id, fields, fields["lastUpdated"].get<std::string>());
+}
+
+json journalUpdateRecord(const BinTable::Row& bin, json changed) {
+    const std::string lastUpdated = bin.lastUpdated();
+    changed["lastUpdated"] = lastUpdated;
+    return makeJournalRecord("update", bin.id(), changed, lastUpdated);
+}
+
+json journalDeleteRecord(int id, const std::string& ts) {
+    return makeJournalRecord("delete", id, nullptr, ts);
+}
+
+// Journal durability policy, modelled on Redis appendfsync:
+//   Always      - every append is written and fsynced before it returns
+//   GroupCommit - appends arriving within a short window share one fsync
+//   Interval    - pending appends are flushed every few seconds
+// In the last two modes the flush runs on a background thread.
+enum class DurabilityMode {
+    Always,
+    GroupCommit,
+    Interval
+};
+
+DurabilityMode parseDurabilityMode(const std::string& name) {
+    if (name == "always") return DurabilityMode::Always;
+    if (name == "group") return DurabilityMode::GroupCommit;
+    if (name == "interval") return DurabilityMode::Interval;
+    throw std::invalid_argument("unknown durability mode '" + name + "' (expected always, group or interval)");
+}
+
+const char* durabilityModeName(DurabilityMode mode) {
+    switch (mode) {
+        case DurabilityMode::Always: return "always";
+        case DurabilityMode::GroupCommit: return "group";
+        case DurabilityMode::Interval: return "interval";
+    }
+    return "unknown";
+}
+
+// Something the durability policy syncs: a journal segment or the mapped
+// bin table. Each change gets a sequence number; waitDurable() blocks until
+// a change is on disk and returns false if it could not be synced.
+//
+// A failed sync is final. Linux reports a writeback error once and marks the
+// failed pages clean, so a later sync that succeeds says nothing about them.
+// The segment therefore stops at the last sequence number it synced: every
+// later change stays non-durable and failed() tells the server to stop
+// accepting writes until it is restarted and recovers from what is on disk.
+// The mapped table latches the same way when it cannot store a change.
+class DurableSegment {
+public:
+    virtual ~DurableSegment() = default;
+
+    virtual void start() = 0;
+    virtual bool hasPending() const = 0;
+    virtual bool waitDurable(uint64_t seq) = 0;
+    virtual void flush() = 0;
+    virtual bool failed() const = 0;
+};
+
+// One journal segment: appends records and makes them durable on request.
+// Every appended record gets a sequence number; durableSeq() is the highest
+// sequence number known to be on disk, and waitDurable() lets a caller block
+// until its own record has been synced. Each store shard owns one segment.
+class JournalWriter : public DurableSegment {
+public:
+    explicit JournalWriter(const std::string& path) : path_(path) {}
+
+    ~JournalWriter() override {
+        flush();
+        closeFile();
+    }
+
+    const std::string& path() const {
+        return path_;
+    }
+
+    void start() override {
+        std::lock_guard<std::mutex> io(ioMutex_);
+        openFile();
+    }
+
+    // Buffer one batch of encoded lines; returns the sequence number of its
+    // last record. Never touches the disk, so it is safe to call while
+    // holding a shard lock; the durability policy decides when it is synced.
+    uint64_t append(const std::string& lines, size_t recordCount) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ += lines;
+        appendedSeq_ += recordCount;
+        return appendedSeq_;
+    }
+
+    bool hasPending() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !pending_.empty() && !failed_;
+    }
+
+    bool failed() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+
+    // Block until every record up to seq is on disk; false if the flush failed
+    bool waitDurable(uint64_t seq) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (durableSeq_ >= seq) {
+                return true;
+            }
+            if (failed_) {
+                return false;
+            }
         }
+        // Flush inline rather than waiting for the next group or interval
+        flush();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        return durableSeq_ >= seq;
+    }
+
+    // Write and fsync everything buffered so far
+    void flush() override {
+        std::lock_guard<std::mutex> io(ioMutex_);
+        flushLocked();
+    }
+
+    uint64_t durableSeq() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return durableSeq_;
+    }
+
+    // Flush and close the journal, run fn (e.g. rename the file away) and
+    // reopen a fresh journal at the same path
+    template <typename Fn>
+    bool withFileClosed(Fn fn) {
+        std::lock_guard<std::mutex> io(ioMutex_);
+        flushLocked();
+        closeFile();
+        bool ok = fn();
+        openFile();
+        return ok;
+    }
 
-        json data = json::parse(file);
-        g_bins.clear();
+private:
+    void openFile() {
+        if (fd_ < 0) {
+            fd_ = ::open(path_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+            if (fd_ < 0) {
+                std::cerr << "Error opening journal " << path_ << ": " << std::strerror(errno) << std::endl;
+            }
+        }
+    }
 
-        for (const auto& item : data) {
-            g_bins.push_back(WasteBin::fromJson(item));
+    void closeFile() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
         }
+    }
 
-        // Update next_bin_id to avoid ID collisions
-        if (!g_bins.empty()) {
-            g_next_bin_id = std::max_element(g_bins.begin(), g_bins.end(),
-                [](const WasteBin& a, const WasteBin& b) { return a.id < b.id; })->id + 1;
-        } else {
-            g_next_bin_id = 1;
+    // Caller holds ioMutex_, which keeps batches in sequence order on disk
+    void flushLocked() {
+        std::string batch;
+        uint64_t seq;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (pending_.empty() || failed_) {
+                return;
+            }
+            batch.swap(pending_);
+            seq = appendedSeq_;
+        }
+
+        openFile();
+        bool ok = fd_ >= 0;
+        bool written = false;
+        const char* data = batch.data();
+        size_t remaining = batch.size();
+        while (ok && remaining > 0) {
+            ssize_t n = ::write(fd_, data, remaining);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Error appending to journal " << path_ << ": " << std::strerror(errno) << std::endl;
+                ok = false;
+                break;
+            }
+            data += n;
+            remaining -= static_cast<size_t>(n);
+        }
+        if (ok) {
+            written = true;
+            if (::fdatasync(fd_) != 0) {
+                std::cerr << "Error syncing journal " << path_ << ": " << std::strerror(errno) << std::endl;
+                ok = false;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok) {
+            durableSeq_ = seq;
+        } else if (written) {
+            // The batch reached the page cache but may never reach the disk,
+            // and syncing again would not tell; see DurableSegment
+            failed_ = true;
+            pending_.clear();
+        } else {
+            // Keep the unwritten tail so the next flush retries it
+            pending_.insert(0, data, remaining);
+        }
+    }
+
+    std::string path_;
+
+    int fd_ = -1;
+    std::mutex ioMutex_;
+
+    mutable std::mutex mutex_;
+    std::string pending_;
+    bool failed_ = false;
+    uint64_t appendedSeq_ = 0;
+    uint64_t durableSeq_ = 0;
+};
+
+#if defined(__BYTE_ORDER__)
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "binary storage formats are little-endian");
+#endif
+
+// Helper: FNV-1a over 64-bit words (then the trailing bytes)
+uint64_t fnv1aChecksum(const char* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    return hash;
+}
+
+// Mapped bin table layout (version 1): MappedTableHeader, then capacity
+// fixed-size MappedTableRecords. A slot without the live flag is free.
+// nextId is the lowest id never stored (0 in tables that predate it).
+// Locations are kept in a separate append-only file (<table>.locations),
+// each distinct location once, and records refer to them by offset.
+const char MAPPED_TABLE_MAGIC[8] = {'S', 'M', 'W', 'S', 'T', 'A', 'B', 'L'};
+const uint32_t MAPPED_TABLE_VERSION = 1;
+
+struct MappedTableHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t capacity;
+    uint64_t nextId;
+    uint64_t reserved[4];
+};
+
+struct MappedTableRecord {
+    int64_t lastUpdated;        // Epoch milliseconds
+    uint64_t locationOffset;
+    uint32_t locationLength;
+    int32_t id;
+    uint8_t fillLevel;
+    uint8_t flags;
+    uint8_t reserved[6];
+};
+
+static_assert(sizeof(MappedTableHeader) == 64, "mapped table header layout changed");
+static_assert(sizeof(MappedTableRecord) == 32, "mapped table record layout changed");
+
+// Storage backend that keeps every bin in a memory-mapped file of
+// fixed-size records, so persisting a change is a few stores into the
+// mapping instead of a journal append and a later snapshot rewrite.
+//
+// A stored change is in the page cache at once and survives a process
+// crash. flush() makes it survive power loss: it syncs the location file
+// first, so a synced record never refers to an unsynced location, then
+// msyncs the range of dirty records. The durability policy decides when
+// flush() runs, as it does for journal segments.
+class MappedBinTable : public DurableSegment {
+public:
+    static constexpr uint8_t LIVE = 1;
+    static constexpr uint8_t NEEDS_COLLECTION = 2;
+
+    ~MappedBinTable() override {
+        if (fd_ >= 0) {
+            flush();
+            for (auto& mapping : retired_) {
+                ::munmap(mapping.first, mapping.second);
+            }
+            ::munmap(base_, mappedBytes());
+            ::close(fd_);
+            ::close(locationsFd_);
+        }
+    }
+
+    bool isOpen() const {
+        return fd_ >= 0;
+    }
+
+    // Open (creating if needed) the table at path; throws if it is damaged
+    void open(const std::string& path) {
+        path_ = path;
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        locationsFd_ = ::open(locationsPath(path).c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+        if (fd_ < 0 || locationsFd_ < 0) {
+            throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+        }
+
+        struct stat info;
+        if (::fstat(fd_, &info) != 0) {
+            throw std::runtime_error("cannot stat " + path + ": " + std::strerror(errno));
+        }
+
+        MappedTableHeader header{};
+        if (info.st_size == 0) {
+            std::memcpy(header.magic, MAPPED_TABLE_MAGIC, sizeof(header.magic));
+            header.version = MAPPED_TABLE_VERSION;
+            header.recordSize = sizeof(MappedTableRecord);
+            if (::pwrite(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+                throw std::runtime_error("cannot initialize " + path + ": " + std::strerror(errno));
+            }
+        } else {
+            if (::pread(fd_, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+                std::memcmp(header.magic, MAPPED_TABLE_MAGIC, sizeof(header.magic)) != 0) {
+                throw std::runtime_error(path + " is not a bin table");
+            }
+            if (header.version != MAPPED_TABLE_VERSION || header.recordSize != sizeof(MappedTableRecord)) {
+                throw std::runtime_error("unsupported bin table version " + std::to_string(header.version));
+            }
+            if (header.capacity > (static_cast<uint64_t>(info.st_size) - sizeof(header)) / sizeof(MappedTableRecord)) {
+                throw std::runtime_error(path + " is truncated");
+            }
+        }
+
+        capacity_ = header.capacity;
+        if (!map()) {
+            throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+        }
+        if (::fstat(locationsFd_, &info) != 0) {
+            throw std::runtime_error("cannot stat " + locationsPath(path) + ": " + std::strerror(errno));
+        }
+        locationsSize_ = static_cast<uint64_t>(info.st_size);
+
+        // Rebuild the slot index; the lowest free slots are reused first
+        for (uint64_t slot = capacity_; slot-- > 0;) {
+            const MappedTableRecord& record = records()[slot];
+            if (!(record.flags & LIVE) || !index_.emplace(record.id, static_cast<uint32_t>(slot)).second) {
+                freeSlots_.push_back(static_cast<uint32_t>(slot));
+            }
+        }
+    }
+
+    // Move the table (and its location file) to path. The location file
+    // moves first; see finishRename() for a crash in between.
+    bool renameTo(const std::string& path) {
+        if (std::rename(locationsPath(path_).c_str(), locationsPath(path).c_str()) != 0 ||
+            std::rename(path_.c_str(), path.c_str()) != 0) {
+            std::cerr << "Error renaming " << path_ << " to " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        path_ = path;
+        return true;
+    }
+
+    // Complete a renameTo(path) from pending that a crash interrupted after
+    // the location file had moved but before the table did
+    static void finishRename(const std::string& pending, const std::string& path) {
+        if (::access(pending.c_str(), F_OK) == 0 && ::access(locationsPath(pending).c_str(), F_OK) != 0) {
+            std::cout << "Finishing the interrupted move of " << pending << " to " << path << std::endl;
+            if (std::rename(pending.c_str(), path.c_str()) != 0) {
+                std::cerr << "Error renaming " << pending << " to " << path << ": " << std::strerror(errno) << std::endl;
+            }
+        }
+    }
+
+    // Take the place of this table with fresh, a table built and synced
+    // under another name: fresh is renamed over this table's path and its
+    // state moved into this object, which the store and the flusher keep
+    // using. Unsynced changes to the old table are superseded and count as
+    // durable.
+    bool replaceWith(MappedBinTable& fresh) {
+        std::lock_guard<std::mutex> io(ioMutex_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::lock_guard<std::mutex> freshLock(fresh.mutex_);
+        if (!fresh.renameTo(path_)) {
+            return false;
+        }
+
+        for (auto& mapping : retired_) {
+            ::munmap(mapping.first, mapping.second);
+        }
+        ::munmap(base_, mappedBytes());
+        ::close(fd_);
+        ::close(locationsFd_);
+
+        fd_ = fresh.fd_;
+        locationsFd_ = fresh.locationsFd_;
+        base_ = fresh.base_;
+        capacity_ = fresh.capacity_;
+        retired_ = std::move(fresh.retired_);
+        index_ = std::move(fresh.index_);
+        freeSlots_ = std::move(fresh.freeSlots_);
+        locationsSize_ = fresh.locationsSize_;
+        locationCache_ = std::move(fresh.locationCache_);
+        dirtyBegin_ = UINT64_MAX;
+        dirtyEnd_ = 0;
+        locationsDirty_ = headerDirty_ = false;
+        durableSeq_ = appendedSeq_;
+
+        fresh.fd_ = fresh.locationsFd_ = -1;
+        fresh.base_ = nullptr;
+        return true;
+    }
+
+    // Lowest id never stored in the table, deleted bins included
+    int64_t nextId() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return static_cast<int64_t>(std::min<uint64_t>(header()->nextId, INT64_MAX));
+    }
+
+    // Load every live bin into the table tableFor(id) returns
+    void load(const std::function<BinTable&(int)>& tableFor) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string locations(locationsSize_, '\0');
+        if (!locations.empty() && ::pread(locationsFd_, &locations[0], locations.size(), 0) != static_cast<ssize_t>(locations.size())) {
+            throw std::runtime_error("cannot read " + locationsPath(path_) + ": " + std::strerror(errno));
+        }
+
+        for (const auto& entry : index_) {
+            const MappedTableRecord& record = records()[entry.second];
+            std::string_view location;
+            if (record.locationOffset <= locations.size() && record.locationLength <= locations.size() - record.locationOffset) {
+                location = std::string_view(locations).substr(record.locationOffset, record.locationLength);
+            } else {
+                std::cerr << "Bin " << record.id << " in " << path_ << " refers to a missing location" << std::endl;
+            }
+
+            uint32_t handle = g_locations.intern(location);
+            rememberLocation(handle, record.locationOffset, record.locationLength);
+            tableFor(record.id).insert(record.id, handle, record.fillLevel, (record.flags & NEEDS_COLLECTION) != 0, record.lastUpdated);
+        }
+    }
+
+    // Replace the whole table with the bins visited by forEachBin(fn), which
+    // must call fn(const BinTable::Row&) once per bin, and sync it. Ids below
+    // nextId stay reserved even if no bin uses them.
+    template <typename ForEachBin>
+    bool reset(ForEachBin&& forEachBin, int64_t nextId) {
+        {
+            std::lock_guard<std::mutex> io(ioMutex_);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (::ftruncate(locationsFd_, 0) != 0) {
+                std::cerr << "Error truncating " << locationsPath(path_) << ": " << std::strerror(errno) << std::endl;
+                return false;
+            }
+            locationsSize_ = 0;
+            locationCache_.clear();
+            index_.clear();
+            freeSlots_.clear();
+            std::memset(records(), 0, capacity_ * sizeof(MappedTableRecord));
+            header()->nextId = static_cast<uint64_t>(std::max<int64_t>(0, nextId));
+            headerDirty_ = true;
+            for (uint64_t slot = capacity_; slot-- > 0;) {
+                freeSlots_.push_back(static_cast<uint32_t>(slot));
+            }
+
+            forEachBin([this](const BinTable::Row& bin) { storeLocked(bin); });
+            markDirty(0, capacity_);
+            locationsDirty_ = true;
+            appendedSeq_++;
+        }
+        flush();
+        return !hasPending() && !failed();
+    }
+
+    // Store changed bins and free erased ones as one change; returns its
+    // sequence number. Never syncs, so it is safe under a shard lock.
+    uint64_t apply(const std::vector<BinTable::Row>& stored, const std::vector<int>& erased) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& bin : stored) {
+            storeLocked(bin);
+        }
+        for (int id : erased) {
+            auto it = index_.find(id);
+            if (it != index_.end()) {
+                records()[it->second].flags = 0;
+                markDirty(it->second, it->second + 1);
+                freeSlots_.push_back(it->second);
+                index_.erase(it);
+            }
+        }
+        return ++appendedSeq_;
+    }
+
+    void start() override {}
+
+    bool hasPending() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return durableSeq_ != appendedSeq_ && !failed_;
+    }
+
+    bool failed() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return failed_;
+    }
+
+    bool waitDurable(uint64_t seq) override {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (durableSeq_ >= seq) {
+                return true;
+            }
+            if (failed_) {
+                return false;
+            }
+        }
+        flush();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        return durableSeq_ >= seq;
+    }
+
+    // Sync the location file, then msync the dirty records
+    void flush() override {
+        std::lock_guard<std::mutex> io(ioMutex_);
+        uint64_t seq, dirtyBegin, dirtyEnd;
+        bool locationsDirty, headerDirty;
+        char* base;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (fd_ < 0 || durableSeq_ == appendedSeq_ || failed_) {
+                return;
+            }
+            // No flush is using the mappings a resize replaced
+            for (auto& mapping : retired_) {
+                ::munmap(mapping.first, mapping.second);
+            }
+            retired_.clear();
+
+            seq = appendedSeq_;
+            base = base_;
+            dirtyBegin = dirtyBegin_;
+            dirtyEnd = dirtyEnd_;
+            locationsDirty = locationsDirty_;
+            headerDirty = headerDirty_;
+            dirtyBegin_ = UINT64_MAX;
+            dirtyEnd_ = 0;
+            locationsDirty_ = headerDirty_ = false;
+        }
+
+        bool ok = !locationsDirty || ::fdatasync(locationsFd_) == 0;
+        if (ok && headerDirty) {
+            ok = ::fdatasync(fd_) == 0;  // The file size or header changed
+        }
+        if (ok && dirtyBegin < dirtyEnd) {
+            const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+            size_t begin = (sizeof(MappedTableHeader) + dirtyBegin * sizeof(MappedTableRecord)) / page * page;
+            size_t end = sizeof(MappedTableHeader) + dirtyEnd * sizeof(MappedTableRecord);
+            ok = ::msync(base + begin, end - begin, MS_SYNC) == 0;
+        }
+        if (!ok) {
+            std::cerr << "Error syncing " << path_ << ": " << std::strerror(errno) << std::endl;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (ok) {
+            durableSeq_ = seq;
+        } else {
+            // The kernel now treats the failed pages as clean, so another
+            // msync would succeed without writing them; see DurableSegment
+            failed_ = true;
+        }
+    }
+
+private:
+    static std::string locationsPath(const std::string& path) {
+        return path + ".locations";
+    }
+
+    MappedTableHeader* header() const {
+        return reinterpret_cast<MappedTableHeader*>(base_);
+    }
+
+    MappedTableRecord* records() const {
+        return reinterpret_cast<MappedTableRecord*>(base_ + sizeof(MappedTableHeader));
+    }
+
+    size_t mappedBytes() const {
+        return sizeof(MappedTableHeader) + capacity_ * sizeof(MappedTableRecord);
+    }
+
+    bool map() {
+        void* mapped = ::mmap(nullptr, mappedBytes(), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        base_ = static_cast<char*>(mapped);
+        return true;
+    }
+
+    // Double the capacity. The old mapping stays valid until the next flush,
+    // which may still be syncing through it.
+    bool grow() {
+        const uint64_t oldCapacity = capacity_;
+        const size_t oldBytes = mappedBytes();
+        const uint64_t capacity = std::max<uint64_t>(1024, capacity_ * 2);
+        if (::ftruncate(fd_, static_cast<off_t>(sizeof(MappedTableHeader) + capacity * sizeof(MappedTableRecord))) != 0) {
+            std::cerr << "Error growing " << path_ << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+
+        char* oldBase = base_;
+        capacity_ = capacity;
+        if (!map()) {
+            std::cerr << "Error mapping " << path_ << ": " << std::strerror(errno) << std::endl;
+            capacity_ = oldCapacity;
+            return false;
+        }
+        header()->capacity = capacity;
+        retired_.emplace_back(oldBase, oldBytes);
+        for (uint64_t slot = capacity; slot-- > oldCapacity;) {
+            freeSlots_.push_back(static_cast<uint32_t>(slot));
+        }
+        headerDirty_ = true;  // The next flush syncs the whole file, header included
+        return true;
+    }
+
+    void markDirty(uint64_t begin, uint64_t end) {
+        dirtyBegin_ = std::min(dirtyBegin_, begin);
+        dirtyEnd_ = std::max(dirtyEnd_, end);
+    }
+
+    void rememberLocation(uint32_t handle, uint64_t offset, uint32_t length) {
+        if (handle >= locationCache_.size()) {
+            locationCache_.resize(handle + 1, {UINT64_MAX, 0});
+        }
+        locationCache_[handle] = {offset, length};
+    }
+
+    // Caller holds mutex_. A failed write latches failed_, as a failed sync
+    // does: the records referring to the location could not be recovered.
+    void appendLocation(uint32_t handle, std::string_view location) {
+        const uint64_t offset = locationsSize_;
+        size_t written = 0;
+        while (written < location.size()) {
+            ssize_t n = ::write(locationsFd_, location.data() + written, location.size() - written);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                std::cerr << "Error appending to " << locationsPath(path_) << ": " << std::strerror(errno) << std::endl;
+                break;
+            }
+            written += static_cast<size_t>(n);
+        }
+        locationsSize_ += written;
+        locationsDirty_ = true;
+        if (written == location.size()) {
+            rememberLocation(handle, offset, static_cast<uint32_t>(written));
+        } else {
+            failed_ = true;
+        }
+    }
+
+    // Caller holds mutex_. A bin that cannot be stored latches failed_, so
+    // its commit fails and later writes are refused.
+    void storeLocked(const BinTable::Row& bin) {
+        uint32_t slot;
+        auto it = index_.find(bin.id());
+        if (it != index_.end()) {
+            slot = it->second;
+        } else {
+            if (freeSlots_.empty() && !grow()) {
+                std::cerr << "Bin " << bin.id() << " not stored in " << path_ << std::endl;
+                failed_ = true;
+                return;
+            }
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+            index_.emplace(bin.id(), slot);
+
+            // Keep the id reserved after the bin is deleted
+            if (static_cast<uint64_t>(bin.id()) >= header()->nextId) {
+                header()->nextId = static_cast<uint64_t>(bin.id()) + 1;
+                headerDirty_ = true;
+            }
+        }
+
+        // Append a location the first time it is stored
+        const uint32_t handle = bin.locationHandle();
+        if (handle >= locationCache_.size() || locationCache_[handle].first == UINT64_MAX) {
+            appendLocation(handle, bin.location());
+            if (failed_) {
+                std::cerr << "Bin " << bin.id() << " not stored in " << path_ << std::endl;
+                return;
+            }
+        }
+        const std::pair<uint64_t, uint32_t> location = locationCache_[handle];
+
+        MappedTableRecord& record = records()[slot];
+        record.lastUpdated = bin.lastUpdatedMs();
+        record.locationOffset = location.first;
+        record.locationLength = location.second;
+        record.id = bin.id();
+        record.fillLevel = static_cast<uint8_t>(bin.fillLevel());
+        record.flags = LIVE | (bin.needsCollection() ? NEEDS_COLLECTION : 0);
+        markDirty(slot, slot + 1);
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    int locationsFd_ = -1;
+    std::mutex ioMutex_;  // Serializes flushes
+
+    mutable std::mutex mutex_;
+    char* base_ = nullptr;
+    uint64_t capacity_ = 0;
+    std::vector<std::pair<char*, size_t>> retired_;
+    std::unordered_map<int, uint32_t> index_;
+    std::vector<uint32_t> freeSlots_;
+    uint64_t locationsSize_ = 0;
+    std::vector<std::pair<uint64_t, uint32_t>> locationCache_;  // Handle -> (offset, length)
+    uint64_t dirtyBegin_ = UINT64_MAX;
+    uint64_t dirtyEnd_ = 0;
+    bool locationsDirty_ = false;
+    bool headerDirty_ = false;
+    bool failed_ = false;
+    uint64_t appendedSeq_ = 0;
+    uint64_t durableSeq_ = 0;
+};
+
+MappedBinTable g_mappedTable;
+
+// Applies the durability policy to every journal segment (or the mapped
+// table). In the group and interval modes one background thread flushes all
+// segments with pending records; in always mode commits flush inline and no
+// thread is started.
+class JournalFlusher {
+public:
+    ~JournalFlusher() {
+        stop();
+    }
+
+    void configure(DurabilityMode mode, std::chrono::milliseconds groupWindow, std::chrono::milliseconds interval) {
+        mode_ = mode;
+        groupWindow_ = groupWindow;
+        interval_ = interval;
+    }
+
+    DurabilityMode mode() const {
+        return mode_;
+    }
+
+    void start(std::vector<DurableSegment*> segments) {
+        segments_ = std::move(segments);
+        for (DurableSegment* segment : segments_) {
+            segment->start();
+        }
+        if (mode_ != DurabilityMode::Always) {
+            worker_ = std::thread([this] { run(); });
+        }
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        flushAll();
+        segments_.clear();
+    }
+
+    // Make seq durable on segment now if the policy (or the caller) requires
+    // it; otherwise wake the background flusher to pick it up. Returns false
+    // when a synchronous flush failed or the segment can no longer sync.
+    bool commit(DurableSegment& segment, uint64_t seq, bool waitForDisk) {
+        if (segment.failed()) {
+            return false;
+        }
+        if (waitForDisk || mode_ == DurabilityMode::Always) {
+            return segment.waitDurable(seq);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            dirty_ = true;
+        }
+        cv_.notify_all();
+        return true;
+    }
+
+    void flushAll() {
+        for (DurableSegment* segment : segments_) {
+            segment->flush();
+        }
+    }
+
+    // Has any segment failed a sync? Writes are refused from then on.
+    bool failed() const {
+        for (DurableSegment* segment : segments_) {
+            if (segment->failed()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            if (mode_ == DurabilityMode::GroupCommit) {
+                cv_.wait(lock, [this] { return stopping_ || dirty_; });
+                // Let the rest of the burst join this commit
+                cv_.wait_for(lock, groupWindow_, [this] { return stopping_; });
+            } else {
+                cv_.wait_for(lock, interval_, [this] { return stopping_; });
+            }
+            dirty_ = false;
+
+            lock.unlock();
+            bool failed = false;
+            for (DurableSegment* segment : segments_) {
+                if (segment->hasPending()) {
+                    segment->flush();
+                    failed = failed || segment->hasPending();
+                }
+            }
+            lock.lock();
+            // Retry a failed write with the next group rather than waiting
+            // for another commit (a failed sync leaves nothing pending)
+            dirty_ = dirty_ || failed;
+        }
+    }
+
+    DurabilityMode mode_ = DurabilityMode::GroupCommit;
+    std::chrono::milliseconds groupWindow_{5};
+    std::chrono::milliseconds interval_{1000};
+
+    std::vector<DurableSegment*> segments_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool dirty_ = false;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+JournalFlusher g_flusher;
+
+// Helper: Encode records as journal lines (one buffer append per batch)
+std::string encodeJournalRecords(const std::vector<json>& records) {
+    std::string lines;
+    for (const auto& record : records) {
+        lines += record.dump();
+        lines += '\n';
+    }
+    return lines;
+}
+
+// Epoch-based reclamation for the published bin table versions.
+//
+// Readers pin the current global epoch in a per-thread slot for the duration
+// of a read and never take a lock. Writers unlink an old version, advance the
+// global epoch and retire the version with the epoch it was unlinked in; it
+// is freed once no reader is still pinned at or before that epoch.
+class EpochManager {
+    static constexpr uint64_t IDLE = UINT64_MAX;
+
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> inUse{false};
+    };
+
+    // Returns this thread's slot to the pool when the thread exits
+    struct ThreadSlot {
+        ReaderSlot* slot = nullptr;
+        ~ThreadSlot() {
+            if (slot != nullptr) {
+                slot->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+public:
+    class Guard {
+    public:
+        explicit Guard(ReaderSlot* slot) : slot_(slot) {}
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() {
+            slot_->epoch.store(IDLE, std::memory_order_release);
+        }
+
+    private:
+        ReaderSlot* slot_;
+    };
+
+    // Pin the current epoch. Pins are not reentrant: a thread must not pin
+    // again while holding a Guard.
+    Guard pin() {
+        ReaderSlot* slot = threadSlot();
+        slot->epoch.store(globalEpoch_.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        return Guard(slot);
+    }
+
+    // Queue a deleter for an object that has just been unlinked
+    void retire(std::function<void()> deleter) {
+        uint64_t epoch = globalEpoch_.fetch_add(1, std::memory_order_seq_cst);
+
+        std::vector<std::function<void()>> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            retired_.emplace_back(epoch, std::move(deleter));
+
+            uint64_t oldest = oldestPinnedEpoch();
+            auto keep = std::partition(retired_.begin(), retired_.end(),
+                [oldest](const std::pair<uint64_t, std::function<void()>>& r) { return r.first >= oldest; });
+            for (auto it = keep; it != retired_.end(); ++it) {
+                ready.push_back(std::move(it->second));
+            }
+            retired_.erase(keep, retired_.end());
+        }
+
+        // Run deleters outside the lock
+        for (auto& deleter : ready) {
+            deleter();
+        }
+    }
+
+private:
+    ReaderSlot* threadSlot() {
+        thread_local ThreadSlot local;
+        if (local.slot == nullptr) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& slot : slots_) {
+                if (!slot.inUse.load(std::memory_order_acquire)) {
+                    local.slot = &slot;
+                    break;
+                }
+            }
+            if (local.slot == nullptr) {
+                slots_.emplace_back();
+                local.slot = &slots_.back();
+            }
+            local.slot->inUse.store(true, std::memory_order_release);
+        }
+        return local.slot;
+    }
+
+    // Caller holds mutex_
+    uint64_t oldestPinnedEpoch() const {
+        uint64_t oldest = IDLE;
+        for (const auto& slot : slots_) {
+            oldest = std::min(oldest, slot.epoch.load(std::memory_order_seq_cst));
+        }
+        return oldest;
+    }
+
+    std::atomic<uint64_t> globalEpoch_{1};
+    std::mutex mutex_;
+    std::deque<ReaderSlot> slots_;  // Stable addresses; slots are reused, never freed
+    std::vector<std::pair<uint64_t, std::function<void()>>> retired_;
+};
+
+
+// Fixed pool of worker threads used to fan scans out across shards
+class ScanPool {
+    struct Job {
+        const std::function<void(size_t)>* fn = nullptr;
+        size_t count = 0;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::exception_ptr error;
+    };
+
+public:
+    ~ScanPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    void start(size_t threads) {
+        for (size_t i = 0; i < threads; i++) {
+            workers_.emplace_back([this] { run(); });
+        }
+    }
+
+    // Run fn(i) for every i in [0, count) on the pool and the calling thread;
+    // returns once all calls are done and rethrows the first exception
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        if (count == 0) {
+            return;
+        }
+
+        auto job = std::make_shared<Job>();
+        job->fn = &fn;
+        job->count = count;
+
+        size_t helpers = std::min(workers_.size(), count - 1);
+        if (helpers > 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (size_t i = 0; i < helpers; i++) {
+                    queue_.push_back(job);
+                }
+            }
+            cv_.notify_all();
+        }
+
+        runJob(*job);
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->cv.wait(lock, [&job] { return job->done.load() == job->count; });
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+
+private:
+    static void runJob(Job& job) {
+        size_t i;
+        while ((i = job.next.fetch_add(1)) < job.count) {
+            try {
+                (*job.fn)(i);
+            }
+            catch (...) {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                if (!job.error) {
+                    job.error = std::current_exception();
+                }
+            }
+
+            if (job.done.fetch_add(1) + 1 == job.count) {
+                std::lock_guard<std::mutex> lock(job.mutex);
+                job.cv.notify_all();
+            }
+        }
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+
+            std::shared_ptr<Job> job = std::move(queue_.front());
+            queue_.pop_front();
+
+            lock.unlock();
+            runJob(*job);
+            lock.lock();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::shared_ptr<Job>> queue_;
+    bool stopping_ = false;
+};
+
+// Consecutive ids share a copy-on-write page; pages are dealt round-robin
+// to the shards, so shard = page % shardCount and the shard keeps the page
+// at local index page / shardCount
+constexpr int BIN_PAGE_SPAN = 64;
+
+size_t pageForId(int id) {
+    return static_cast<unsigned>(id) / BIN_PAGE_SPAN;
+}
+
+// Fill-level scan kernels over a BinTable fill column. Freed slots hold fill
+// 0, so callers correct for them with the table's live count where needed.
+// Each kernel has AVX2 and SSE4.2 variants picked once at startup from what
+// the CPU supports (SMWS_SCAN_KERNELS=avx2|sse4.2|scalar overrides it), and a
+// scalar fallback used everywhere else and for the tails.
+struct ScanKernels {
+    const char* name;
+    // Sum of fill[0, count)
+    uint64_t (*sumFill)(const uint8_t* fill, size_t count);
+    // Number of fill[0, count) >= threshold
+    size_t (*countAtLeast)(const uint8_t* fill, size_t count, uint8_t threshold);
+    // Sets bit i of mask (bitWords(count) words, overwritten) iff
+    // lo <= fill[i] <= hi
+    void (*selectFillRange)(const uint8_t* fill, size_t count, uint8_t lo, uint8_t hi, uint64_t* mask);
+};
+
+uint64_t sumFillScalar(const uint8_t* fill, size_t count) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; i++) {
+        sum += fill[i];
+    }
+    return sum;
+}
+
+size_t countAtLeastScalar(const uint8_t* fill, size_t count, uint8_t threshold) {
+    size_t result = 0;
+    for (size_t i = 0; i < count; i++) {
+        result += fill[i] >= threshold;
+    }
+    return result;
+}
+
+void selectFillRangeScalar(const uint8_t* fill, size_t count, uint8_t lo, uint8_t hi, uint64_t* mask) {
+    for (size_t word = 0; word * 64 < count; word++) {
+        const size_t end = std::min(count, word * 64 + 64);
+        uint64_t bits = 0;
+        for (size_t i = word * 64; i < end; i++) {
+            bits |= uint64_t(fill[i] >= lo && fill[i] <= hi) << (i % 64);
+        }
+        mask[word] = bits;
+    }
+}
+
+#if defined(__x86_64__)
+// Unsigned byte compares via min/max: v >= t <=> max(v, t) == v
+
+__attribute__((target("avx2")))
+uint64_t sumFillAvx2(const uint8_t* fill, size_t count) {
+    __m256i total = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fill + i));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(v, _mm256_setzero_si256()));
+    }
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumFillScalar(fill + i, count - i);
+}
+
+__attribute__((target("avx2")))
+size_t countAtLeastAvx2(const uint8_t* fill, size_t count, uint8_t threshold) {
+    const __m256i t = _mm256_set1_epi8(static_cast<char>(threshold));
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fill + i));
+        __m256i ge = _mm256_cmpeq_epi8(_mm256_max_epu8(v, t), v);
+        result += __builtin_popcount(static_cast<uint32_t>(_mm256_movemask_epi8(ge)));
+    }
+    return result + countAtLeastScalar(fill + i, count - i, threshold);
+}
+
+__attribute__((target("avx2")))
+void selectFillRangeAvx2(const uint8_t* fill, size_t count, uint8_t lo, uint8_t hi, uint64_t* mask) {
+    const __m256i l = _mm256_set1_epi8(static_cast<char>(lo));
+    const __m256i h = _mm256_set1_epi8(static_cast<char>(hi));
+    size_t word = 0;
+    for (; word * 64 + 64 <= count; word++) {
+        uint64_t bits = 0;
+        for (int half = 0; half < 2; half++) {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(fill + word * 64 + half * 32));
+            __m256i in = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(v, l), v),
+                                          _mm256_cmpeq_epi8(_mm256_min_epu8(v, h), v));
+            bits |= uint64_t(static_cast<uint32_t>(_mm256_movemask_epi8(in))) << (half * 32);
+        }
+        mask[word] = bits;
+    }
+    if (word * 64 < count) {
+        selectFillRangeScalar(fill + word * 64, count - word * 64, lo, hi, mask + word);
+    }
+}
+
+__attribute__((target("sse4.2")))
+uint64_t sumFillSse42(const uint8_t* fill, size_t count) {
+    __m128i total = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fill + i));
+        total = _mm_add_epi64(total, _mm_sad_epu8(v, _mm_setzero_si128()));
+    }
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(total)) +
+           static_cast<uint64_t>(_mm_extract_epi64(total, 1)) + sumFillScalar(fill + i, count - i);
+}
+
+__attribute__((target("sse4.2")))
+size_t countAtLeastSse42(const uint8_t* fill, size_t count, uint8_t threshold) {
+    const __m128i t = _mm_set1_epi8(static_cast<char>(threshold));
+    size_t result = 0;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fill + i));
+        __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(v, t), v);
+        result += __builtin_popcount(static_cast<uint32_t>(_mm_movemask_epi8(ge)));
+    }
+    return result + countAtLeastScalar(fill + i, count - i, threshold);
+}
+
+__attribute__((target("sse4.2")))
+void selectFillRangeSse42(const uint8_t* fill, size_t count, uint8_t lo, uint8_t hi, uint64_t* mask) {
+    const __m128i l = _mm_set1_epi8(static_cast<char>(lo));
+    const __m128i h = _mm_set1_epi8(static_cast<char>(hi));
+    size_t word = 0;
+    for (; word * 64 + 64 <= count; word++) {
+        uint64_t bits = 0;
+        for (int quarter = 0; quarter < 4; quarter++) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(fill + word * 64 + quarter * 16));
+            __m128i in = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, l), v),
+                                       _mm_cmpeq_epi8(_mm_min_epu8(v, h), v));
+            bits |= uint64_t(static_cast<uint32_t>(_mm_movemask_epi8(in))) << (quarter * 16);
+        }
+        mask[word] = bits;
+    }
+    if (word * 64 < count) {
+        selectFillRangeScalar(fill + word * 64, count - word * 64, lo, hi, mask + word);
+    }
+}
+#endif
+
+// Helper: Every kernel set this CPU can run, fastest first
+std::vector<ScanKernels> availableScanKernels() {
+    std::vector<ScanKernels> result;
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        result.push_back({"avx2", sumFillAvx2, countAtLeastAvx2, selectFillRangeAvx2});
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        result.push_back({"sse4.2", sumFillSse42, countAtLeastSse42, selectFillRangeSse42});
+    }
+#endif
+    result.push_back({"scalar", sumFillScalar, countAtLeastScalar, selectFillRangeScalar});
+    return result;
+}
+
+// Helper: The kernels to use on this machine, chosen on first use
+const ScanKernels& scanKernels() {
+    static const ScanKernels kernels = [] {
+        const std::vector<ScanKernels> available = availableScanKernels();
+        const std::string wanted = getEnvString("SMWS_SCAN_KERNELS", "");
+        for (const auto& candidate : available) {
+            if (wanted == candidate.name) {
+                return candidate;
+            }
+        }
+        return available.front();
+    }();
+    return kernels;
+}
+
+// Helper: Visit the bins of a table with lo <= fillLevel <= hi and, unless
+// needsCollection is -1, that flag equal to it. Slots are selected 64 at a
+// time by combining the fill range mask from the scan kernels with the live
+// and needsCollection bitsets; bins are visited in slot order.
+template <typename Fn>
+void forEachFillMatch(const BinTable& table, int lo, int hi, int needsCollection, Fn&& fn) {
+    const size_t slots = table.slotCount();
+    const uint64_t* live = table.liveBits();
+    const uint64_t* collect = table.collectBits();
+    const bool wholeRange = lo <= 0 && hi >= 100;  // Stored fill levels are 0..100
+    if (!wholeRange && (lo > hi || lo > 100 || hi < 0)) {
+        return;
+    }
+
+    uint64_t rangeMask = ~uint64_t(0);
+    for (size_t word = 0; word * 64 < slots; word++) {
+        if (!wholeRange) {
+            scanKernels().selectFillRange(table.fillColumn() + word * 64, std::min<size_t>(64, slots - word * 64),
+                                          static_cast<uint8_t>(std::max(lo, 0)),
+                                          static_cast<uint8_t>(std::min(hi, 100)), &rangeMask);
+        }
+        uint64_t bits = live[word] & rangeMask;
+        if (needsCollection == 1) {
+            bits &= collect[word];
+        } else if (needsCollection == 0) {
+            bits &= ~collect[word];
+        }
+        while (bits != 0) {
+            uint32_t slot = static_cast<uint32_t>(word * 64 + __builtin_ctzll(bits));
+            bits &= bits - 1;
+            fn(BinTable::Row(&table, slot));
+        }
+    }
+}
+
+// Fill levels at which the low/medium/high/critical buckets start
+constexpr uint8_t FILL_MEDIUM_MIN = 25;
+constexpr uint8_t FILL_HIGH_MIN = 50;
+constexpr uint8_t FILL_CRITICAL_MIN = 75;
+
+// Fill level from which a sensor reading flags a bin for collection
+constexpr int COLLECTION_THRESHOLD = 75;
+
+// Counters a shard maintains alongside its bins. Writers keep them up to
+// date bin by bin, so /dashboard/stats never has to scan.
+struct ShardAggregates {
+    enum FillBucket { FILL_LOW, FILL_MEDIUM, FILL_HIGH, FILL_CRITICAL, FILL_BUCKETS };
+
+    size_t bins = 0;
+    int64_t fillSum = 0;
+    int64_t needsCollection = 0;
+    int64_t fillBuckets[FILL_BUCKETS] = {};
+
+    static FillBucket bucketFor(int fillLevel) {
+        if (fillLevel < FILL_MEDIUM_MIN) return FILL_LOW;
+        if (fillLevel < FILL_HIGH_MIN) return FILL_MEDIUM;
+        if (fillLevel < FILL_CRITICAL_MIN) return FILL_HIGH;
+        return FILL_CRITICAL;
+    }
+
+    // Add (sign = 1) or remove (sign = -1) a bin's share of the fill
+    // statistics; bins is tracked separately by the writer
+    void account(const BinTable::Row& bin, int sign) {
+        fillSum += sign * bin.fillLevel();
+        needsCollection += bin.needsCollection() ? sign : 0;
+        fillBuckets[bucketFor(bin.fillLevel())] += sign;
+    }
+
+    ShardAggregates& operator+=(const ShardAggregates& other) {
+        bins += other.bins;
+        fillSum += other.fillSum;
+        needsCollection += other.needsCollection;
+        for (int i = 0; i < FILL_BUCKETS; i++) {
+            fillBuckets[i] += other.fillBuckets[i];
+        }
+        return *this;
+    }
+
+    bool operator==(const ShardAggregates& other) const {
+        return bins == other.bins && fillSum == other.fillSum && needsCollection == other.needsCollection &&
+               std::equal(std::begin(fillBuckets), std::end(fillBuckets), std::begin(other.fillBuckets));
+    }
+};
+
+// Helper: Aggregates of every bin in a table, read straight from its fill
+// and needsCollection columns
+ShardAggregates aggregateTable(const BinTable& table) {
+    ShardAggregates result;
+    result.bins = table.size();
+
+    const uint8_t* fill = table.fillColumn();
+    const uint64_t* live = table.liveBits();
+    const uint64_t* collect = table.collectBits();
+    const size_t slots = table.slotCount();
+    for (size_t word = 0; word * 64 < slots; word++) {
+        result.needsCollection += __builtin_popcountll(collect[word] & live[word]);
+    }
+
+    // Freed slots read as fill 0: they add nothing to the sum and only land
+    // in the low bucket, which is derived from the live count instead
+    const ScanKernels& kernels = scanKernels();
+    const int64_t medium = static_cast<int64_t>(kernels.countAtLeast(fill, slots, FILL_MEDIUM_MIN));
+    const int64_t high = static_cast<int64_t>(kernels.countAtLeast(fill, slots, FILL_HIGH_MIN));
+    const int64_t critical = static_cast<int64_t>(kernels.countAtLeast(fill, slots, FILL_CRITICAL_MIN));
+    result.fillSum = static_cast<int64_t>(kernels.sumFill(fill, slots));
+    result.fillBuckets[ShardAggregates::FILL_LOW] = static_cast<int64_t>(result.bins) - medium;
+    result.fillBuckets[ShardAggregates::FILL_MEDIUM] = medium - high;
+    result.fillBuckets[ShardAggregates::FILL_HIGH] = high - critical;
+    result.fillBuckets[ShardAggregates::FILL_CRITICAL] = critical;
+    return result;
+}
+
+// One immutable, published version of a shard. Pages are shared between
+// versions; a write copies only the pages it touches. Empty pages are null.
+struct ShardVersion : std::enable_shared_from_this<ShardVersion> {
+    std::vector<std::shared_ptr<const BinTable>> pages;
+    ShardAggregates aggregates;
+};
+
+// Read-only view of one version of every shard
+class BinSnapshot {
+public:
+    BinSnapshot(std::vector<const ShardVersion*> shards,
+                std::vector<std::shared_ptr<const ShardVersion>> owned = {})
+        : shards_(std::move(shards)), owned_(std::move(owned)) {}
+
+    size_t shardCount() const { return shards_.size(); }
+    const ShardVersion& shard(size_t index) const { return *shards_[index]; }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const ShardVersion* shard : shards_) {
+            total += shard->aggregates.bins;
+        }
+        return total;
+    }
+
+    bool empty() const { return size() == 0; }
+
+    // Totals over every shard, O(shards)
+    ShardAggregates aggregates() const {
+        ShardAggregates total;
+        for (const ShardVersion* shard : shards_) {
+            total += shard->aggregates;
+        }
+        return total;
+    }
+
+    BinTable::Row find(int id) const {
+        size_t page = pageForId(id);
+        const ShardVersion& shard = *shards_[page % shards_.size()];
+        size_t local = page / shards_.size();
+        if (local >= shard.pages.size() || shard.pages[local] == nullptr) {
+            return BinTable::Row();
+        }
+        return shard.pages[local]->find(id);
+    }
+
+    // Visit every bin of one shard, page by page
+    template <typename Fn>
+    void forEachInShard(size_t index, Fn&& fn) const {
+        for (const auto& page : shards_[index]->pages) {
+            if (page != nullptr) {
+                for (const auto& bin : *page) {
+                    fn(bin);
+                }
+            }
+        }
+    }
+
+    // Visit every bin in insertion order. Ids are handed out in increasing
+    // order, so walking the pages in id order restores the global order.
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        size_t pageCount = globalPageCount();
+        for (size_t page = 0; page < pageCount; page++) {
+            if (const BinTable* table = pageAt(page)) {
+                for (const auto& bin : *table) {
+                    fn(bin);
+                }
+            }
+        }
+    }
+
+    // Number of global page indexes a scan has to cover
+    size_t globalPageCount() const {
+        size_t count = 0;
+        for (size_t i = 0; i < shards_.size(); i++) {
+            if (!shards_[i]->pages.empty()) {
+                count = std::max(count, (shards_[i]->pages.size() - 1) * shards_.size() + i + 1);
+            }
+        }
+        return count;
+    }
+
+    const BinTable* pageAt(size_t page) const {
+        const ShardVersion& shard = *shards_[page % shards_.size()];
+        size_t local = page / shards_.size();
+        return local < shard.pages.size() ? shard.pages[local].get() : nullptr;
+    }
+
+private:
+    std::vector<const ShardVersion*> shards_;
+    std::vector<std::shared_ptr<const ShardVersion>> owned_;  // Set when the snapshot outlives an epoch pin
+};
+
+// Journal segments a mutation has to reach before it is durable
+struct CommitTicket {
+    std::vector<std::pair<DurableSegment*, uint64_t>> segments;
+};
+
+// One fill-level history sample
+struct FillSample {
+    int64_t timestamp;  // Epoch milliseconds
+    int fillLevel;
+};
+
+// Compressed history block (Gorilla-style): the samples of one bin packed
+// into a bit stream, most significant bit first.
+//   first sample: 64-bit timestamp, 7-bit fill level
+//   timestamp:    delta-of-delta against the previous interval
+//                   '0'                  0
+//                   '10'   + 7 bits      -64..63
+//                   '110'  + 12 bits     -2048..2047
+//                   '1110' + 20 bits     -524288..524287
+//                   '1111' + 64 bits     anything else
+//   fill level:   delta against the previous sample
+//                   '0'                  unchanged
+//                   '10'   + 4 bits      -8..7
+//                   '11'   + 8 bits      -128..127
+// Sensors reporting on a fixed schedule cost one bit per timestamp, and
+// slowly filling bins a few bits per fill level.
+class HistoryBlockEncoder {
+public:
+    size_t count() const { return count_; }
+    int64_t firstTimestamp() const { return first_; }
+    int64_t lastTimestamp() const { return last_; }
+    const std::vector<uint8_t>& bytes() const { return bytes_; }
+
+    void append(int64_t timestamp, int fillLevel) {
+        if (count_ == 0) {
+            writeBits(static_cast<uint64_t>(timestamp), 64);
+            writeBits(static_cast<uint64_t>(fillLevel), 7);
+            first_ = timestamp;
+        } else {
+            const int64_t delta = timestamp - last_;
+            const int64_t dod = delta - delta_;
+            if (dod == 0) {
+                writeBits(0, 1);
+            } else if (fits(dod, 7)) {
+                writeBits(0b10, 2);
+                writeBits(static_cast<uint64_t>(dod), 7);
+            } else if (fits(dod, 12)) {
+                writeBits(0b110, 3);
+                writeBits(static_cast<uint64_t>(dod), 12);
+            } else if (fits(dod, 20)) {
+                writeBits(0b1110, 4);
+                writeBits(static_cast<uint64_t>(dod), 20);
+            } else {
+                writeBits(0b1111, 4);
+                writeBits(static_cast<uint64_t>(dod), 64);
+            }
+            delta_ = delta;
+
+            const int change = fillLevel - fill_;
+            if (change == 0) {
+                writeBits(0, 1);
+            } else if (fits(change, 4)) {
+                writeBits(0b10, 2);
+                writeBits(static_cast<uint64_t>(change), 4);
+            } else {
+                writeBits(0b11, 2);
+                writeBits(static_cast<uint64_t>(change), 8);
+            }
+        }
+        last_ = timestamp;
+        fill_ = fillLevel;
+        count_++;
+    }
+
+    void reset() {
+        bytes_.clear();
+        bitCount_ = 0;
+        count_ = 0;
+        delta_ = 0;
+    }
+
+private:
+    static bool fits(int64_t value, unsigned bits) {
+        const int64_t limit = int64_t{1} << (bits - 1);
+        return value >= -limit && value < limit;
+    }
+
+    // Append the low bits of value
+    void writeBits(uint64_t value, unsigned bits) {
+        while (bits > 0) {
+            if (bitCount_ % 8 == 0) {
+                bytes_.push_back(0);
+            }
+            const unsigned room = 8 - bitCount_ % 8;
+            const unsigned take = std::min(room, bits);
+            const uint64_t chunk = (value >> (bits - take)) & ((1u << take) - 1);
+            bytes_.back() |= static_cast<uint8_t>(chunk << (room - take));
+            bits -= take;
+            bitCount_ += take;
+        }
+    }
+
+    std::vector<uint8_t> bytes_;
+    size_t bitCount_ = 0;
+    size_t count_ = 0;
+    int64_t first_ = 0;
+    int64_t last_ = 0;
+    int64_t delta_ = 0;
+    int fill_ = 0;
+};
+
+// Streaming decoder for one HistoryBlockEncoder block: next() yields the
+// samples one at a time, so a reader can stop early without decoding the
+// rest of the block
+class HistoryBlockDecoder {
+public:
+    HistoryBlockDecoder(const uint8_t* data, size_t size, size_t count)
+        : data_(data), bitSize_(size * 8), remaining_(count) {}
+
+    // false once every sample has been read or the stream is truncated
+    bool next(FillSample& sample) {
+        if (remaining_ == 0) {
+            return false;
+        }
+
+        if (!started_) {
+            last_ = static_cast<int64_t>(readBits(64));
+            fill_ = static_cast<int>(readBits(7));
+            started_ = true;
+        } else {
+            int64_t dod = 0;
+            if (readBits(1) != 0) {
+                if (readBits(1) == 0) {
+                    dod = signExtend(readBits(7), 7);
+                } else if (readBits(1) == 0) {
+                    dod = signExtend(readBits(12), 12);
+                } else if (readBits(1) == 0) {
+                    dod = signExtend(readBits(20), 20);
+                } else {
+                    dod = static_cast<int64_t>(readBits(64));
+                }
+            }
+            delta_ += dod;
+            last_ += delta_;
+
+            if (readBits(1) != 0) {
+                fill_ += readBits(1) == 0 ? static_cast<int>(signExtend(readBits(4), 4))
+                                          : static_cast<int>(signExtend(readBits(8), 8));
+            }
+        }
+
+        if (truncated_) {
+            remaining_ = 0;
+            return false;
+        }
+        remaining_--;
+        sample = FillSample{last_, fill_};
+        return true;
+    }
+
+private:
+    static int64_t signExtend(uint64_t value, unsigned bits) {
+        return static_cast<int64_t>(value << (64 - bits)) >> (64 - bits);
+    }
+
+    uint64_t readBits(unsigned bits) {
+        uint64_t value = 0;
+        while (bits > 0) {
+            if (bit_ >= bitSize_) {
+                truncated_ = true;
+                return 0;
+            }
+            const unsigned room = 8 - bit_ % 8;
+            const unsigned take = std::min(room, bits);
+            const unsigned byte = data_[bit_ / 8];
+            value = (value << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+            bits -= take;
+            bit_ += take;
+        }
+        return value;
+    }
+
+    const uint8_t* data_;
+    size_t bitSize_;
+    size_t bit_ = 0;
+    size_t remaining_;
+    bool started_ = false;
+    bool truncated_ = false;
+    int64_t last_ = 0;
+    int64_t delta_ = 0;
+    int fill_ = 0;
+};
+
+// Sealed history archive layout: blocks appended as they fill up, each a
+// HistoryBlockHeader followed by header.bytes of encoded samples. A bin's
+// blocks are appended in time order. The checksum covers the encoded
+// samples. A header with count 0 and no samples is a tombstone: the bin was
+// deleted and its earlier blocks are ignored.
+const std::string HISTORY_FILE = "bin_data.history";
+const char HISTORY_BLOCK_MAGIC[4] = {'S', 'M', 'H', 'B'};
+constexpr size_t HISTORY_BLOCK_SAMPLES = 120;  // Samples per sealed block
+
+struct HistoryBlockHeader {
+    char magic[4];
+    int32_t binId;
+    uint32_t count;
+    uint32_t bytes;
+    int64_t firstTimestamp;
+    int64_t lastTimestamp;
+    uint64_t checksum;
+};
+
+static_assert(sizeof(HistoryBlockHeader) == 40, "history block header layout changed");
+
+// Append-only file of sealed history blocks with an in-memory index of
+// each bin's blocks (offset and last timestamp), so a time-range query
+// reads and decodes only the blocks that overlap it.
+//
+// Blocks reach the file with a plain write: they survive a process crash
+// at once and are synced by flush(). A torn block at the end of the file
+// (from a crash mid-append) is cut off when the archive is opened.
+class HistoryArchive {
+public:
+    struct BlockRef {
+        uint64_t offset;
+        int64_t lastTimestamp;
+    };
+
+    struct Usage {
+        size_t blocks = 0;
+        size_t bytes = 0;  // File size
+    };
+
+    ~HistoryArchive() {
+        if (fd_ >= 0) {
+            flush();
+            ::close(fd_);
+        }
+    }
+
+    bool isOpen() const {
+        return fd_ >= 0;
+    }
+
+    // Open (or create) the archive and index its blocks
+    bool open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Error opening " << path << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0) {
+            std::cerr << "Error reading " << path << ": " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+
+        const uint64_t size = static_cast<uint64_t>(info.st_size);
+        uint64_t offset = 0;
+        HistoryBlockHeader header;
+        while (offset + sizeof(header) <= size &&
+               ::pread(fd, &header, sizeof(header), static_cast<off_t>(offset)) == static_cast<ssize_t>(sizeof(header)) &&
+               std::memcmp(header.magic, HISTORY_BLOCK_MAGIC, sizeof(header.magic)) == 0 &&
+               offset + sizeof(header) + header.bytes <= size) {
+            if (header.count == 0) {
+                auto it = index_.find(header.binId);
+                if (it != index_.end()) {
+                    blocks_ -= it->second.size();
+                    index_.erase(it);
+                }
+            } else {
+                index_[header.binId].push_back(BlockRef{offset, header.lastTimestamp});
+                blocks_++;
+            }
+            offset += sizeof(header) + header.bytes;
+        }
+        if (offset < size) {
+            std::cerr << "Discarding " << (size - offset) << " unreadable bytes at the end of " << path << std::endl;
+            if (::ftruncate(fd, static_cast<off_t>(offset)) != 0) {
+                std::cerr << "Error truncating " << path << ": " << std::strerror(errno) << std::endl;
+                ::close(fd);
+                return false;
+            }
+        }
+
+        fd_ = fd;
+        end_ = offset;
+        path_ = path;
+        return true;
+    }
+
+    // Seal a block of one bin's samples
+    void append(int id, const HistoryBlockEncoder& block) {
+        const std::vector<uint8_t>& bytes = block.bytes();
+        HistoryBlockHeader header{};
+        std::memcpy(header.magic, HISTORY_BLOCK_MAGIC, sizeof(header.magic));
+        header.binId = id;
+        header.count = static_cast<uint32_t>(block.count());
+        header.bytes = static_cast<uint32_t>(bytes.size());
+        header.firstTimestamp = block.firstTimestamp();
+        header.lastTimestamp = block.lastTimestamp();
+        header.checksum = fnv1aChecksum(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+
+        std::string record(sizeof(header) + bytes.size(), '\0');
+        std::memcpy(&record[0], &header, sizeof(header));
+        std::memcpy(&record[sizeof(header)], bytes.data(), bytes.size());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        // A failed write leaves end_ alone, so the next block overwrites it
+        if (::pwrite(fd_, record.data(), record.size(), static_cast<off_t>(end_)) != static_cast<ssize_t>(record.size())) {
+            std::cerr << "Error writing history block for bin " << id << " to " << path_ << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        index_[id].push_back(BlockRef{end_, header.lastTimestamp});
+        blocks_++;
+        end_ += record.size();
+    }
+
+    // Drop a deleted bin from the index and append its tombstone, so its
+    // blocks (which stay in the file) are not indexed again on restart
+    void forget(int id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(id);
+        if (it == index_.end()) {
+            return;
+        }
+        blocks_ -= it->second.size();
+        index_.erase(it);
+
+        HistoryBlockHeader header{};
+        std::memcpy(header.magic, HISTORY_BLOCK_MAGIC, sizeof(header.magic));
+        header.binId = id;
+        header.checksum = fnv1aChecksum(nullptr, 0);
+        if (::pwrite(fd_, &header, sizeof(header), static_cast<off_t>(end_)) != static_cast<ssize_t>(sizeof(header))) {
+            std::cerr << "Error writing history tombstone for bin " << id << " to " << path_ << ": " << std::strerror(errno) << std::endl;
+            return;
+        }
+        end_ += sizeof(header);
+    }
+
+    // Drop every block (when the bins are replaced wholesale)
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (::ftruncate(fd_, 0) != 0) {
+            std::cerr << "Error truncating " << path_ << ": " << std::strerror(errno) << std::endl;
+        }
+        index_.clear();
+        blocks_ = 0;
+        end_ = 0;
+    }
+
+    // The bin's blocks that may hold samples at or after from, oldest first
+    std::vector<BlockRef> blocks(int id, int64_t from) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(id);
+        if (it == index_.end()) {
+            return {};
+        }
+        auto first = std::lower_bound(it->second.begin(), it->second.end(), from,
+                                      [](const BlockRef& block, int64_t time) { return block.lastTimestamp < time; });
+        return std::vector<BlockRef>(first, it->second.end());
+    }
+
+    // Stream the samples in [from, to) of bin id's blocks to fn, reading
+    // and decoding one block at a time; stops at the first sample at or
+    // after to
+    template <typename Fn>
+    void forEachSample(int id, const std::vector<BlockRef>& blocks, int64_t from, int64_t to, Fn&& fn) const {
+        std::vector<uint8_t> buffer;
+        for (const BlockRef& block : blocks) {
+            HistoryBlockHeader header;
+            // A block listed before a concurrent clear() is gone or replaced,
+            // possibly by another bin's block with the same last timestamp
+            // (bins updated by one batch share it)
+            if (::pread(fd_, &header, sizeof(header), static_cast<off_t>(block.offset)) != static_cast<ssize_t>(sizeof(header)) ||
+                header.count == 0 || header.binId != id || header.lastTimestamp != block.lastTimestamp) {
+                return;
+            }
+            if (header.firstTimestamp >= to) {
+                return;
+            }
+            buffer.resize(header.bytes);
+            if (::pread(fd_, buffer.data(), buffer.size(), static_cast<off_t>(block.offset + sizeof(header))) !=
+                    static_cast<ssize_t>(buffer.size()) ||
+                fnv1aChecksum(reinterpret_cast<const char*>(buffer.data()), buffer.size()) != header.checksum) {
+                std::cerr << "Skipping corrupt history block of bin " << header.binId << " at offset " << block.offset << std::endl;
+                continue;
+            }
+
+            HistoryBlockDecoder decoder(buffer.data(), buffer.size(), header.count);
+            FillSample sample;
+            while (decoder.next(sample)) {
+                if (sample.timestamp >= to) {
+                    return;
+                }
+                if (sample.timestamp >= from) {
+                    fn(sample);
+                }
+            }
+        }
+    }
+
+    void flush() {
+        if (fd_ >= 0 && ::fdatasync(fd_) != 0) {
+            std::cerr << "Error syncing " << path_ << ": " << std::strerror(errno) << std::endl;
+        }
+    }
+
+    Usage usage() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Usage{blocks_, static_cast<size_t>(end_)};
+    }
+
+private:
+    int fd_ = -1;
+    std::string path_;
+    uint64_t end_ = 0;
+    size_t blocks_ = 0;
+    mutable std::mutex mutex_;
+    std::unordered_map<int, std::vector<BlockRef>> index_;
+};
+
+HistoryArchive g_historyArchive;
+
+// Fill-level history of one shard's bins: a ring of (timestamp, fill)
+// samples per bin holding at most capacity samples, so memory per bin is
+// bounded. Rings come from size-class pools (4, 8, 16, ... samples, capped
+// at capacity) carved out of fixed-size blocks, and a ring moves to the next
+// class only when it fills up, so rarely updated bins stay small. Freed
+// rings go on their class's free list for reuse. Samples are kept in time
+// order; one older than the bin's newest sample is dropped.
+//
+// With the archive open, samples pushed out of a full ring are compressed
+// into the bin's open block, which is sealed into g_historyArchive once it
+// holds HISTORY_BLOCK_SAMPLES; queries read the archive, the open block and
+// the ring in turn.
+class FillHistory {
+public:
+    using Sample = FillSample;
+
+    struct Usage {
+        size_t bins = 0;
+        size_t samples = 0;
+        size_t bytes = 0;  // Pool blocks plus the per-bin index
+    };
+
+    explicit FillHistory(size_t capacity) : capacity_(capacity) {
+        for (size_t size = MIN_RING; capacity > 0; size *= 2) {
+            pools_.emplace_back(std::min(size, capacity));
+            if (size >= capacity) {
+                break;
+            }
+        }
+    }
+
+    size_t capacity() const { return capacity_; }
+
+    // Append a bin's current state, unless it matches the newest sample
+    void record(int id, int64_t timestamp, int fillLevel) {
+        if (capacity_ == 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, added] = rings_.try_emplace(id);
+        Ring& ring = it->second;
+        if (added) {
+            ring.slot = allocate(ring.sizeClass);
+        } else if (ring.count > 0) {
+            const size_t newest = at(ring, ring.count - 1);
+            const Pool& pool = pools_[ring.sizeClass];
+            if (timestamp < pool.timestamp(newest) ||
+                (timestamp == pool.timestamp(newest) && fillLevel == pool.fill(newest))) {
+                return;
+            }
+        }
+
+        if (ring.count == pools_[ring.sizeClass].ringSize) {
+            if (ring.sizeClass + 1u < pools_.size()) {
+                grow(ring);
+            } else {
+                archive(id, ring);
+                ring.head = (ring.head + 1) % ring.count;  // Overwrite the oldest
+                ring.count--;
+            }
+        }
+
+        Pool& pool = pools_[ring.sizeClass];
+        const size_t index = at(ring, ring.count++);
+        pool.timestamp(index) = timestamp;
+        pool.fill(index) = static_cast<uint8_t>(std::max(0, std::min(100, fillLevel)));
+    }
+
+    // Forget a deleted bin and return its ring to the pool
+    void release(int id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = rings_.find(id);
+        if (it != rings_.end()) {
+            pools_[it->second.sizeClass].freeSlots.push_back(it->second.slot);
+            rings_.erase(it);
+        }
+        if (g_historyArchive.isOpen()) {
+            g_historyArchive.forget(id);
+        }
+    }
+
+    // Seal every bin's open block and ring into the archive and empty the
+    // rings (at shutdown, so no samples are lost)
+    void sealAll() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!g_historyArchive.isOpen()) {
+            return;
+        }
+        for (auto& entry : rings_) {
+            Ring& ring = entry.second;
+            while (ring.count > 0) {
+                archive(entry.first, ring);
+                ring.head = (ring.head + 1) % pools_[ring.sizeClass].ringSize;
+                ring.count--;
+            }
+            if (ring.open != nullptr && ring.open->count() > 0) {
+                g_historyArchive.append(entry.first, *ring.open);
+            }
+            ring.open.reset();
+        }
+    }
+
+    // Forget every bin (the shard's data was replaced); pool blocks are kept
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.clear();
+        for (auto& pool : pools_) {
+            pool.freeSlots.clear();
+            pool.usedSlots = 0;
+        }
+    }
+
+    // Call fn(const Sample&) for the bin's samples in [from, to), oldest
+    // first. The open block and ring (bounded) are copied under the lock
+    // together with the list of sealed blocks, so a concurrent seal cannot
+    // skip or repeat samples; sealed blocks are then streamed from disk.
+    template <typename Fn>
+    void forEachSample(int id, int64_t from, int64_t to, Fn&& fn) const {
+        std::vector<Sample> recent;
+        std::vector<HistoryArchive::BlockRef> sealed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (g_historyArchive.isOpen()) {
+                sealed = g_historyArchive.blocks(id, from);
+            }
+            auto it = rings_.find(id);
+            if (it != rings_.end()) {
+                const Ring& ring = it->second;
+                auto keep = [&](const Sample& sample) {
+                    if (sample.timestamp >= from && sample.timestamp < to) {
+                        recent.push_back(sample);
+                    }
+                };
+                if (ring.open != nullptr) {
+                    const std::vector<uint8_t>& bytes = ring.open->bytes();
+                    HistoryBlockDecoder decoder(bytes.data(), bytes.size(), ring.open->count());
+                    Sample sample;
+                    while (decoder.next(sample)) {
+                        keep(sample);
+                    }
+                }
+                const Pool& pool = pools_[ring.sizeClass];
+                for (size_t i = 0; i < ring.count; i++) {
+                    const size_t index = at(ring, i);
+                    keep(Sample{pool.timestamp(index), pool.fill(index)});
+                }
+            }
+        }
+
+        g_historyArchive.forEachSample(id, sealed, from, to, fn);
+        for (const Sample& sample : recent) {
+            fn(sample);
+        }
+    }
+
+    Usage usage() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Usage usage;
+        usage.bins = rings_.size();
+        for (const auto& entry : rings_) {
+            usage.samples += entry.second.count;
+            if (entry.second.open != nullptr) {
+                usage.samples += entry.second.open->count();
+                usage.bytes += sizeof(HistoryBlockEncoder) + entry.second.open->bytes().capacity();
+            }
+        }
+        for (const auto& pool : pools_) {
+            usage.bytes += pool.timestamps.size() * pool.blockSamples() * (sizeof(int64_t) + sizeof(uint8_t));
+        }
+        usage.bytes += rings_.bucket_count() * sizeof(void*) + rings_.size() * (sizeof(int) + sizeof(Ring) + 2 * sizeof(void*));
+        return usage;
+    }
+
+private:
+    static constexpr size_t MIN_RING = 4;
+    static constexpr size_t BLOCK_SAMPLES = 4096;  // Samples per pool block
+
+    // Rings of one size, stored structure-of-arrays in blocks that never move
+    struct Pool {
+        explicit Pool(size_t size) : ringSize(size) {}
+
+        size_t ringSize;
+        std::vector<std::unique_ptr<int64_t[]>> timestamps;
+        std::vector<std::unique_ptr<uint8_t[]>> fills;
+        std::vector<uint32_t> freeSlots;
+        uint32_t usedSlots = 0;  // Slots handed out from the blocks so far
+
+        size_t ringsPerBlock() const { return std::max<size_t>(1, BLOCK_SAMPLES / ringSize); }
+        size_t blockSamples() const { return ringsPerBlock() * ringSize; }
+
+        // Sample index = slot * ringSize + position within the ring
+        int64_t& timestamp(size_t index) {
+            return timestamps[index / blockSamples()][index % blockSamples()];
+        }
+        int64_t timestamp(size_t index) const {
+            return timestamps[index / blockSamples()][index % blockSamples()];
+        }
+        uint8_t& fill(size_t index) {
+            return fills[index / blockSamples()][index % blockSamples()];
+        }
+        int fill(size_t index) const {
+            return fills[index / blockSamples()][index % blockSamples()];
+        }
+    };
+
+    struct Ring {
+        uint32_t slot = 0;
+        uint32_t head = 0;   // Position of the oldest sample
+        uint32_t count = 0;
+        uint8_t sizeClass = 0;
+        std::unique_ptr<HistoryBlockEncoder> open;  // Samples pushed out of the ring, not yet sealed
+    };
+
+    // Pool index of the ring's i-th oldest sample
+    size_t at(const Ring& ring, size_t i) const {
+        const size_t size = pools_[ring.sizeClass].ringSize;
+        return static_cast<size_t>(ring.slot) * size + (ring.head + i) % size;
+    }
+
+    uint32_t allocate(size_t sizeClass) {
+        Pool& pool = pools_[sizeClass];
+        if (!pool.freeSlots.empty()) {
+            uint32_t slot = pool.freeSlots.back();
+            pool.freeSlots.pop_back();
+            return slot;
+        }
+        if (pool.usedSlots == pool.timestamps.size() * pool.ringsPerBlock()) {
+            pool.timestamps.emplace_back(new int64_t[pool.blockSamples()]);
+            pool.fills.emplace_back(new uint8_t[pool.blockSamples()]);
+        }
+        return pool.usedSlots++;
+    }
+
+    // Compress the ring's oldest sample into the bin's open block, sealing
+    // the block once it is full. Without the archive the sample is dropped.
+    void archive(int id, Ring& ring) {
+        if (!g_historyArchive.isOpen()) {
+            return;
+        }
+        if (ring.open == nullptr) {
+            ring.open = std::make_unique<HistoryBlockEncoder>();
+        }
+        const Pool& pool = pools_[ring.sizeClass];
+        const size_t oldest = at(ring, 0);
+        ring.open->append(pool.timestamp(oldest), pool.fill(oldest));
+        if (ring.open->count() == HISTORY_BLOCK_SAMPLES) {
+            g_historyArchive.append(id, *ring.open);
+            ring.open->reset();
+        }
+    }
+
+    // Move a full ring to the next size class, oldest sample first
+    void grow(Ring& ring) {
+        Ring old;
+        old.slot = ring.slot;
+        old.head = ring.head;
+        old.count = ring.count;
+        old.sizeClass = ring.sizeClass;
+        ring.sizeClass++;
+        ring.slot = allocate(ring.sizeClass);
+        ring.head = 0;
+        const Pool& from = pools_[old.sizeClass];
+        Pool& to = pools_[ring.sizeClass];
+        for (size_t i = 0; i < old.count; i++) {
+            const size_t source = at(old, i);
+            const size_t target = at(ring, i);
+            to.timestamp(target) = from.timestamp(source);
+            to.fill(target) = static_cast<uint8_t>(from.fill(source));
+        }
+        pools_[old.sizeClass].freeSlots.push_back(old.slot);
+    }
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    std::unordered_map<int, Ring> rings_;
+    std::vector<Pool> pools_;
+};
+
+// Aggregate of the readings in one rollup period (an hour or a day)
+template <typename Sum>
+struct RollupCell {
+    int32_t period = -1;  // Hours or days since the epoch; -1 when empty
+    uint32_t count = 0;
+    Sum sum = 0;
+    uint8_t min = 0;
+    uint8_t max = 0;
+
+    void add(int fillLevel) {
+        const uint8_t fill = static_cast<uint8_t>(std::max(0, std::min(100, fillLevel)));
+        min = count == 0 ? fill : std::min(min, fill);
+        max = count == 0 ? fill : std::max(max, fill);
+        sum += fill;
+        count++;
+    }
+
+    template <typename OtherSum>
+    void merge(const RollupCell<OtherSum>& other) {
+        min = count == 0 ? other.min : std::min(min, other.min);
+        max = count == 0 ? other.max : std::max(max, other.max);
+        sum += other.sum;
+        count += other.count;
+    }
+};
+
+// Retention of the rollup tables; 0 hours and 0 days disables them
+struct RollupRetention {
+    size_t hours = 0;
+    size_t days = 0;
+};
+
+// Helper: District a location belongs to: the text after its last comma
+// ("12 Main St, Downtown" -> "Downtown"), or the whole location
+std::string_view districtOf(std::string_view location) {
+    const size_t comma = location.rfind(',');
+    std::string_view district = comma == std::string_view::npos ? location : location.substr(comma + 1);
+    while (!district.empty() && district.front() == ' ') {
+        district.remove_prefix(1);
+    }
+    while (!district.empty() && district.back() == ' ') {
+        district.remove_suffix(1);
+    }
+    return district;
+}
+
+// Fill-level rollups of one shard's readings: min/max/sum/count per UTC
+// hour and day, for each bin and for each district, kept for the last
+// retention.hours hours and retention.days days. Each owner (bin or
+// district) has a row of hours + days cells used as two rings indexed by
+// period, so adding a reading is two cell updates per owner and a query
+// never touches raw samples. Bin rows (16-byte cells) come from fixed-size
+// blocks with a free list; district rows carry 64-bit sums. Districts are
+// summed across shards when queried.
+class FillRollups {
+public:
+    using BinCell = RollupCell<uint32_t>;
+    using DistrictCell = RollupCell<uint64_t>;
+
+    enum Resolution { HOUR, DAY };
+
+    struct Usage {
+        size_t bins = 0;
+        size_t districts = 0;
+        size_t bytes = 0;
+    };
+
+    explicit FillRollups(RollupRetention retention)
+        : retention_(retention), rowCells_(retention.hours + retention.days) {}
+
+    const RollupRetention& retention() const { return retention_; }
+
+    static int32_t periodOf(int64_t timestamp, Resolution resolution) {
+        const int64_t length = resolution == HOUR ? 3600000 : 86400000;
+        return static_cast<int32_t>(timestamp / length - (timestamp % length < 0 ? 1 : 0));
+    }
+
+    static int64_t periodStart(int32_t period, Resolution resolution) {
+        return static_cast<int64_t>(period) * (resolution == HOUR ? 3600000 : 86400000);
+    }
+
+    // Add a reading of a bin (its current fill level and lastUpdated),
+    // unless it repeats the bin's last added reading
+    void add(const BinTable::Row& bin) {
+        if (rowCells_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        addLocked(bin, bin.lastUpdatedMs(), bin.fillLevel(), false);
+    }
+
+    // Add a reading replayed from the journal at startup (bin gives its
+    // district), unless the saved rollups already counted it. A bin's
+    // readings are applied in time order, so one before the bin's last
+    // counted reading was counted too.
+    void addReplayed(const BinTable::Row& bin, int64_t timestamp, int fillLevel) {
+        if (rowCells_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        addLocked(bin, timestamp, fillLevel, true);
+    }
+
+    // Drop everything (when the bins are replaced wholesale)
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bins_.clear();
+        districts_.clear();
+        blocks_.clear();
+        freeSlots_.clear();
+        usedSlots_ = 0;
+        changes_++;  // The saved file no longer matches
+    }
+
+    // Readings added so far, to tell whether the rollups need saving
+    uint64_t changes() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return changes_;
+    }
+
+    // Forget a deleted bin; its readings stay in its district's rollups
+    void release(int id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = bins_.find(id);
+        if (it != bins_.end()) {
+            freeSlots_.push_back(it->second.slot);
+            bins_.erase(it);
+        }
+    }
+
+    // Merge the cells of a bin (district == nullptr) or of a district for
+    // periods in [from, to) into out, keyed by period
+    template <typename Cell>
+    void collect(const int* binId, const std::string* district, Resolution resolution,
+                 int32_t from, int32_t to, std::map<int32_t, Cell>& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (binId != nullptr) {
+            auto it = bins_.find(*binId);
+            if (it != bins_.end()) {
+                collectRow(binCells(it->second.slot), resolution, from, to, out);
+            }
+        } else {
+            auto it = districts_.find(*district);
+            if (it != districts_.end()) {
+                collectRow(it->second.data(), resolution, from, to, out);
+            }
+        }
+    }
+
+    // Names of the districts this shard has readings for
+    void districtNames(std::set<std::string>& out) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : districts_) {
+            out.insert(entry.first);
+        }
+    }
+
+    // Call fn(binId, resolution, cell) for each non-empty bin cell, then
+    // fn(district, resolution, cell) for each non-empty district cell
+    template <typename BinFn, typename DistrictFn>
+    void forEachCell(BinFn&& binFn, DistrictFn&& districtFn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : bins_) {
+            const BinCell* cells = binCells(entry.second.slot);
+            for (size_t i = 0; i < rowCells_; i++) {
+                if (cells[i].count > 0) {
+                    binFn(entry.first, i < retention_.hours ? HOUR : DAY, cells[i]);
+                }
+            }
+        }
+        for (const auto& entry : districts_) {
+            for (size_t i = 0; i < rowCells_; i++) {
+                if (entry.second[i].count > 0) {
+                    districtFn(entry.first, i < retention_.hours ? HOUR : DAY, entry.second[i]);
+                }
+            }
+        }
+    }
+
+    // Call fn(binId, timestamp, fillLevel) with each bin's last counted
+    // reading
+    template <typename Fn>
+    void forEachLastReading(Fn&& fn) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (const auto& entry : bins_) {
+            if (entry.second.lastTimestamp != INT64_MIN) {
+                fn(entry.first, entry.second.lastTimestamp, entry.second.lastFill);
+            }
+        }
+    }
+
+    // The bin's last counted reading, if any
+    bool lastReading(int id, int64_t& timestamp, int& fillLevel) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = bins_.find(id);
+        if (it == bins_.end() || it->second.lastTimestamp == INT64_MIN) {
+            return false;
+        }
+        timestamp = it->second.lastTimestamp;
+        fillLevel = it->second.lastFill;
+        return true;
+    }
+
+    // Restore a bin's last counted reading (when loading)
+    void restoreLastReading(int id, int64_t timestamp, int fillLevel) {
+        if (rowCells_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, added] = bins_.try_emplace(id);
+        if (added) {
+            it->second.slot = allocate();
+        }
+        it->second.lastTimestamp = timestamp;
+        it->second.lastFill = static_cast<uint8_t>(fillLevel);
+    }
+
+    // Merge saved cells back in (when loading); cells outside the
+    // retention are dropped
+    void restoreBin(int id, Resolution resolution, const BinCell& cell) {
+        if (rowCells_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto [it, added] = bins_.try_emplace(id);
+        if (added) {
+            it->second.slot = allocate();
+        }
+        restoreCell(binCells(it->second.slot), resolution, cell);
+    }
+
+    void restoreDistrict(const std::string& district, Resolution resolution, const DistrictCell& cell) {
+        if (rowCells_ == 0) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        restoreCell(districtRow(district).data(), resolution, cell);
+    }
+
+    Usage usage() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Usage usage;
+        usage.bins = bins_.size();
+        usage.districts = districts_.size();
+        usage.bytes = blocks_.size() * ROWS_PER_BLOCK * rowCells_ * sizeof(BinCell) +
+                      bins_.bucket_count() * sizeof(void*) + bins_.size() * (sizeof(int) + sizeof(BinRow) + 2 * sizeof(void*)) +
+                      districts_.size() * rowCells_ * sizeof(DistrictCell);
+        return usage;
+    }
+
+private:
+    static constexpr size_t ROWS_PER_BLOCK = 256;
+
+    struct BinRow {
+        uint32_t slot = 0;
+        uint32_t locationHandle = 0;
+        std::vector<DistrictCell>* district = nullptr;  // Cached for locationHandle
+        int64_t lastTimestamp = INT64_MIN;              // Last added reading
+        uint8_t lastFill = 0;
+    };
+
+    BinCell* binCells(uint32_t slot) {
+        return blocks_[slot / ROWS_PER_BLOCK].get() + (slot % ROWS_PER_BLOCK) * rowCells_;
+    }
+    const BinCell* binCells(uint32_t slot) const {
+        return blocks_[slot / ROWS_PER_BLOCK].get() + (slot % ROWS_PER_BLOCK) * rowCells_;
+    }
+
+    // Caller holds mutex_
+    void addLocked(const BinTable::Row& bin, int64_t timestamp, int fillLevel, bool replayed) {
+        auto [it, added] = bins_.try_emplace(bin.id());
+        BinRow& row = it->second;
+        if (added) {
+            row.slot = allocate();
+        } else if ((row.lastTimestamp == timestamp && row.lastFill == fillLevel) ||
+                   (replayed && timestamp < row.lastTimestamp)) {
+            return;
+        }
+        row.lastTimestamp = timestamp;
+        row.lastFill = static_cast<uint8_t>(fillLevel);
+        if (row.district == nullptr || row.locationHandle != bin.locationHandle()) {
+            row.locationHandle = bin.locationHandle();
+            row.district = &districtRow(districtOf(bin.location()));
+        }
+
+        addTo(binCells(row.slot), timestamp, fillLevel);
+        addTo(row.district->data(), timestamp, fillLevel);
+        changes_++;
+    }
+
+    uint32_t allocate() {
+        uint32_t slot;
+        if (!freeSlots_.empty()) {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        } else {
+            if (usedSlots_ == blocks_.size() * ROWS_PER_BLOCK) {
+                blocks_.emplace_back(new BinCell[ROWS_PER_BLOCK * rowCells_]);
+            }
+            slot = usedSlots_++;
+        }
+        std::fill_n(binCells(slot), rowCells_, BinCell());
+        return slot;
+    }
+
+    std::vector<DistrictCell>& districtRow(std::string_view district) {
+        auto it = districts_.find(std::string(district));
+        if (it == districts_.end()) {
+            it = districts_.emplace(std::string(district), std::vector<DistrictCell>(rowCells_)).first;
+        }
+        return it->second;
+    }
+
+    // The cell a period maps to, or nullptr when the resolution is not kept
+    template <typename Cell>
+    Cell* cellFor(Cell* row, Resolution resolution, int32_t period) const {
+        const size_t size = resolution == HOUR ? retention_.hours : retention_.days;
+        if (size == 0) {
+            return nullptr;
+        }
+        const int64_t slot = ((static_cast<int64_t>(period) % static_cast<int64_t>(size)) + size) % size;
+        return row + (resolution == HOUR ? 0 : retention_.hours) + slot;
+    }
+
+    // Count a reading in its hour and day; a cell still holding a newer
+    // period keeps it (the reading is older than the retention)
+    template <typename Cell>
+    void addTo(Cell* row, int64_t timestamp, int fillLevel) {
+        for (Resolution resolution : {HOUR, DAY}) {
+            const int32_t period = periodOf(timestamp, resolution);
+            Cell* cell = cellFor(row, resolution, period);
+            if (cell == nullptr || cell->period > period) {
+                continue;
+            }
+            if (cell->period < period) {
+                *cell = Cell();
+                cell->period = period;
+            }
+            cell->add(fillLevel);
+        }
+    }
+
+    template <typename Cell, typename Saved>
+    void restoreCell(Cell* row, Resolution resolution, const Saved& saved) {
+        Cell* cell = cellFor(row, resolution, saved.period);
+        if (cell == nullptr || cell->period > saved.period) {
+            return;
+        }
+        if (cell->period < saved.period) {
+            *cell = Cell();
+            cell->period = saved.period;
+        }
+        cell->merge(saved);
+    }
+
+    template <typename Cell, typename Out>
+    void collectRow(const Cell* row, Resolution resolution, int32_t from, int32_t to, std::map<int32_t, Out>& out) const {
+        const size_t size = resolution == HOUR ? retention_.hours : retention_.days;
+        const Cell* cells = row + (resolution == HOUR ? 0 : retention_.hours);
+        for (size_t i = 0; i < size; i++) {
+            if (cells[i].count > 0 && cells[i].period >= from && cells[i].period < to) {
+                Out& merged = out[cells[i].period];
+                merged.period = cells[i].period;
+                merged.merge(cells[i]);
+            }
+        }
+    }
+
+    const RollupRetention retention_;
+    const size_t rowCells_;
+    mutable std::mutex mutex_;
+    std::unordered_map<int, BinRow> bins_;
+    std::vector<std::unique_ptr<BinCell[]>> blocks_;
+    std::vector<uint32_t> freeSlots_;
+    uint32_t usedSlots_ = 0;
+    std::unordered_map<std::string, std::vector<DistrictCell>> districts_;
+    uint64_t changes_ = 0;
+};
+
+// Mutable view of one shard handed to BinStore::write(). The first change
+// to a page copies it; untouched pages are shared with the previous version.
+class ShardWriter {
+public:
+    ShardWriter(const ShardVersion& base, size_t shardCount, JournalWriter& journal, MappedBinTable* table,
+                FillHistory& history, FillRollups& rollups)
+        : base_(base), pages_(base.pages), copied_(base.pages.size(), nullptr), aggregates_(base.aggregates),
+          shardCount_(shardCount), journal_(journal), table_(table), history_(history), rollups_(rollups) {}
+
+    size_t size() const { return aggregates_.bins; }
+    bool empty() const { return aggregates_.bins == 0; }
+
+    BinTable::RowRef find(int id) {
+        size_t local = localPage(id);
+        if (local >= pages_.size() || pages_[local] == nullptr || !pages_[local]->find(id)) {
+            return BinTable::RowRef();  // Don't copy a page for a miss
+        }
+        BinTable::RowRef bin = mutablePage(local).find(id);
+        touch(bin);
+        return bin;
+    }
+
+    void insert(const WasteBin& bin) {
+        BinTable& page = mutablePage(localPage(bin.id));
+        if (BinTable::RowRef existing = page.find(bin.id)) {
+            touch(existing);
+        }
+        size_t before = page.size();
+        page.insert(bin);
+        aggregates_.bins += page.size() - before;
+        touched_.insert(bin.id);
+        erased_.erase(bin.id);
+    }
+
+    bool erase(int id) {
+        if (!find(id)) {
+            return false;
+        }
+        mutablePage(localPage(id)).erase(id);
+        touched_.erase(id);
+        erased_.insert(id);
+        aggregates_.bins--;
+        return true;
+    }
+
+    // Visit every bin of the shard for update (copies every non-empty page)
+    template <typename Fn>
+    void forEach(Fn&& fn) {
+        for (size_t i = 0; i < pages_.size(); i++) {
+            if (pages_[i] != nullptr && !pages_[i]->empty()) {
+                for (BinTable::RowRef bin : mutablePage(i)) {
+                    touch(bin);
+                    fn(bin);
+                }
+            }
+        }
+    }
+
+    // Buffer records in this shard's journal segment. With a mapped table
+    // the changed bins are stored by build() instead.
+    void journal(const std::vector<json>& records) {
+        if (!records.empty() && table_ == nullptr) {
+            journalSeq_ = journal_.append(encodeJournalRecords(records), records.size());
+        }
+    }
+
+    void journal(const json& record) {
+        journal(std::vector<json>{record});
+    }
+
+    // Record an intermediate reading of a bin in its history and rollups.
+    // build() records each changed bin's final state; a batch that changes
+    // one bin several times calls this after each change so no reading is
+    // lost. Both skip a repeat of the bin's newest reading, so the final
+    // state is not counted twice.
+    void recordSample(const BinTable::Row& bin) {
+        history_.record(bin.id(), bin.lastUpdatedMs(), bin.fillLevel());
+        rollups_.add(bin);
+    }
+
+    uint64_t journalSeq() const { return journalSeq_; }
+    DurableSegment& durableSegment() { return table_ != nullptr ? static_cast<DurableSegment&>(*table_) : journal_; }
+
+    bool changed() const {
+        return std::any_of(copied_.begin(), copied_.end(), [](BinTable* t) { return t != nullptr; });
+    }
+
+    std::shared_ptr<ShardVersion> build() {
+        // Add back the (possibly changed) bins handed out for update
+        std::vector<BinTable::Row> stored;
+        for (int id : touched_) {
+            BinTable::Row bin = copied_[localPage(id)]->find(id);
+            aggregates_.account(bin, 1);
+            if (isNewReading(bin)) {
+                history_.record(id, bin.lastUpdatedMs(), bin.fillLevel());
+                rollups_.add(bin);
+            }
+            if (table_ != nullptr) {
+                stored.push_back(bin);
+            }
+        }
+        touched_.clear();
+        for (int id : erased_) {
+            history_.release(id);
+            rollups_.release(id);
+        }
+
+        if (table_ != nullptr && (!stored.empty() || !erased_.empty())) {
+            journalSeq_ = table_->apply(stored, std::vector<int>(erased_.begin(), erased_.end()));
+        }
+        erased_.clear();
+
+        // Only copied pages can hold changed bins; published pages are
+        // immutable, so their fragments stay valid
+        for (BinTable* page : copied_) {
+            if (page != nullptr) {
+                page->refreshFragments();
+            }
+        }
+
+        auto version = std::make_shared<ShardVersion>();
+        // Drop empty trailing pages so scans stop early
+        while (!pages_.empty() && (pages_.back() == nullptr || pages_.back()->empty())) {
+            pages_.pop_back();
+        }
+        version->pages = std::move(pages_);
+        version->aggregates = aggregates_;
+        return version;
+    }
+
+private:
+    size_t localPage(int id) const {
+        return pageForId(id) / shardCount_;
+    }
+
+    // Does the bin's final state differ from the published version?
+    bool isNewReading(const BinTable::Row& bin) const {
+        const size_t local = localPage(bin.id());
+        if (local < base_.pages.size() && base_.pages[local] != nullptr) {
+            if (BinTable::Row before = base_.pages[local]->find(bin.id())) {
+                return before.lastUpdatedMs() != bin.lastUpdatedMs() || before.fillLevel() != bin.fillLevel();
+            }
+        }
+        return true;
+    }
+
+    // A bin handed out for update leaves the fill statistics until build()
+    // adds it back with its final values
+    void touch(const BinTable::Row& bin) {
+        if (touched_.insert(bin.id()).second) {
+            aggregates_.account(bin, -1);
+        }
+    }
+
+    BinTable& mutablePage(size_t local) {
+        if (local >= pages_.size()) {
+            pages_.resize(local + 1);
+            copied_.resize(local + 1, nullptr);
+        }
+        if (copied_[local] == nullptr) {
+            auto copy = pages_[local] != nullptr ? std::make_shared<BinTable>(*pages_[local]) : std::make_shared<BinTable>();
+            copied_[local] = copy.get();
+            pages_[local] = std::move(copy);
+        }
+        return *copied_[local];
+    }
+
+    const ShardVersion& base_;
+    std::vector<std::shared_ptr<const BinTable>> pages_;
+    std::vector<BinTable*> copied_;
+    ShardAggregates aggregates_;
+    std::unordered_set<int> touched_;
+    size_t shardCount_;
+    std::unordered_set<int> erased_;
+    JournalWriter& journal_;
+    MappedBinTable* table_;
+    FillHistory& history_;
+    FillRollups& rollups_;
+    uint64_t journalSeq_ = 0;
+};
+
+// One partition of the store: its own writer lock, journal segment and
+// published version
+struct BinShard {
+    BinShard(const std::string& journalPath, size_t historySamples, RollupRetention rollupRetention)
+        : journal(journalPath), history(historySamples), rollups(rollupRetention) {}
+
+    std::mutex writeMutex;
+    std::shared_ptr<const ShardVersion> current;
+    std::atomic<const ShardVersion*> published{nullptr};
+    JournalWriter journal;
+    FillHistory history;  // Recorded by the writer as it publishes
+    FillRollups rollups;  // Likewise
+};
+
+// Helper: Journal segment path for a shard
+std::string journalSegmentPath(size_t shard) {
+    return JOURNAL_FILE + "." + std::to_string(shard);
+}
+
+// Bins being loaded, already split by store shard so that loaders and
+// BinStore::replace() can work on the shards in parallel
+class ShardedBins {
+public:
+    explicit ShardedBins(size_t shardCount) : parts_(shardCount) {}
+
+    size_t shardCount() const { return parts_.size(); }
+
+    // Same mapping as BinStore::shardForId()
+    size_t shardForId(int id) const { return pageForId(id) % parts_.size(); }
+
+    BinTable& forId(int id) { return parts_[shardForId(id)]; }
+    BinTable& part(size_t shard) { return parts_[shard]; }
+    const BinTable& part(size_t shard) const { return parts_[shard]; }
+
+    size_t size() const {
+        size_t total = 0;
+        for (const auto& part : parts_) {
+            total += part.size();
+        }
+        return total;
+    }
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (const auto& part : parts_) {
+            for (const auto& bin : part) {
+                fn(bin);
+            }
+        }
+    }
+
+    // Ids below this were handed out before, possibly to bins deleted since,
+    // and must not be allocated again. Deleted bins leave no row, so the
+    // snapshot, the mapped table and the journal carry it separately.
+    int64_t reservedIds() const { return reservedIds_; }
+
+    void reserveIds(int64_t nextId) {
+        reservedIds_ = std::max(reservedIds_, nextId);
+    }
+
+private:
+    std::vector<BinTable> parts_;
+    int64_t reservedIds_ = 1;
+};
+
+// Owner of the bin table and the id allocator, split into shards.
+// Handlers run on httplib's thread pool. Each shard has its own writer lock
+// and journal segment, so writers to different shards never contend; point
+// operations touch only the shard that owns the id. Readers never lock:
+// they pin an epoch and read the currently published immutable version of
+// each shard. Writers build the next version copy-on-write and publish it
+// with an atomic pointer swap; the old version is reclaimed once no reader
+// can still see it. Fleet-wide scans fan out across shards on a ScanPool.
+class BinStore {
+public:
+    // Create the shards, keeping up to historySamples fill-level samples per
+    // bin (0 disables history) and rollups for the given retention; must
+    // run before any other use
+    void init(size_t shardCount, size_t scanThreads, size_t historySamples, RollupRetention rollupRetention) {
+        for (size_t i = 0; i < shardCount; i++) {
+            shards_.push_back(std::make_unique<BinShard>(journalSegmentPath(i), historySamples, rollupRetention));
+            publish(*shards_.back(), std::make_shared<ShardVersion>());
+        }
+        pool_.start(scanThreads);
+    }
+
+    size_t shardCount() const {
+        return shards_.size();
+    }
+
+    // Persist changes to a mapped table instead of the journal segments
+    void persistTo(MappedBinTable* table) {
+        table_ = table;
+    }
+
+    MappedBinTable* mappedTable() const {
+        return table_;
+    }
+
+    size_t shardForId(int id) const {
+        return pageForId(id) % shards_.size();
+    }
+
+    std::vector<JournalWriter*> journalSegments() {
+        std::vector<JournalWriter*> segments;
+        for (auto& shard : shards_) {
+            segments.push_back(&shard->journal);
+        }
+        return segments;
+    }
+
+    // Hand out the next bin id; ids are never reused, also across restarts
+    int allocateId() {
+        return nextId_.fetch_add(1);
+    }
+
+    // Lowest id not yet handed out, persisted with snapshots
+    int nextId() const {
+        return nextId_.load();
+    }
+
+    // Run fn(const BinSnapshot&) against the current versions, lock-free.
+    // Each shard is internally consistent; a scan may observe one shard
+    // before and another after a concurrent multi-shard write.
+    template <typename Fn>
+    auto read(Fn&& fn) const -> decltype(fn(std::declval<const BinSnapshot&>())) {
+        auto guard = epochs_.pin();
+        std::vector<const ShardVersion*> versions;
+        versions.reserve(shards_.size());
+        for (const auto& shard : shards_) {
+            versions.push_back(shard->published.load(std::memory_order_seq_cst));
+        }
+        BinSnapshot snapshot(std::move(versions));
+        return fn(snapshot);
+    }
+
+    // A snapshot that stays valid beyond a single read (for long scans such
+    // as snapshot writing or streaming) without holding an epoch pin
+    BinSnapshot acquire() const {
+        auto guard = epochs_.pin();
+        std::vector<const ShardVersion*> versions;
+        std::vector<std::shared_ptr<const ShardVersion>> owned;
+        for (const auto& shard : shards_) {
+            owned.push_back(shard->published.load(std::memory_order_seq_cst)->shared_from_this());
+            versions.push_back(owned.back().get());
+        }
+        return BinSnapshot(std::move(versions), std::move(owned));
+    }
+
+    // Run fn(ShardWriter&) under one shard's writer lock and publish the
+    // result; the journal segment and sequence it wrote go on the ticket
+    template <typename Fn>
+    auto write(size_t shardIndex, CommitTicket& ticket, Fn&& fn) -> decltype(fn(std::declval<ShardWriter&>())) {
+        BinShard& shard = *shards_[shardIndex];
+        std::lock_guard<std::mutex> lock(shard.writeMutex);
+        ShardWriter writer(*shard.current, shards_.size(), shard.journal, table_, shard.history, shard.rollups);
+        Publisher publisher(*this, shard, writer, ticket);
+        return fn(writer);
+    }
+
+    // Run fn(i) for every shard index in parallel
+    void parallelForShards(const std::function<void(size_t)>& fn) {
+        pool_.parallelFor(shards_.size(), fn);
+    }
+
+    // Run fn(i) for every i in [0, count) in parallel
+    void parallelFor(size_t count, const std::function<void(size_t)>& fn) {
+        pool_.parallelFor(count, fn);
+    }
+
+    // Run fn with every shard's writers paused and return the versions it
+    // ran against. Used to take a consistent cut between the journal and a
+    // snapshot.
+    template <typename Fn>
+    BinSnapshot cut(Fn&& fn) {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (auto& shard : shards_) {
+            locks.emplace_back(shard->writeMutex);
+        }
+        fn();
+
+        std::vector<const ShardVersion*> versions;
+        std::vector<std::shared_ptr<const ShardVersion>> owned;
+        for (auto& shard : shards_) {
+            owned.push_back(shard->current);
+            versions.push_back(owned.back().get());
+        }
+        return BinSnapshot(std::move(versions), std::move(owned));
+    }
+
+    // Swap in freshly loaded bins, building the shards in parallel. If
+    // given, beforePublish runs with writers paused just before the swap;
+    // returning false cancels it.
+    bool replace(const ShardedBins& bins, const std::function<bool()>& beforePublish = nullptr) {
+        std::vector<std::unique_lock<std::mutex>> locks;
+        for (auto& shard : shards_) {
+            locks.emplace_back(shard->writeMutex);
+        }
+
+        std::vector<std::shared_ptr<ShardVersion>> versions(shards_.size());
+        std::vector<int> maxIds(shards_.size(), 0);
+        parallelForShards([&](size_t i) {
+            std::vector<std::shared_ptr<BinTable>> pages;
+            for (const auto& bin : bins.part(i)) {
+                size_t local = pageForId(bin.id()) / shards_.size();
+                if (local >= pages.size()) {
+                    pages.resize(local + 1);
+                }
+                if (pages[local] == nullptr) {
+                    pages[local] = std::make_shared<BinTable>();
+                }
+                pages[local]->insert(bin);
+            }
+
+            auto version = std::make_shared<ShardVersion>();
+            for (auto& page : pages) {
+                if (page != nullptr) {
+                    page->refreshFragments();
+                    version->aggregates += aggregateTable(*page);
+                }
+                version->pages.push_back(std::move(page));
+            }
+            versions[i] = std::move(version);
+            maxIds[i] = bins.part(i).maxId();
+        });
+
+        if (beforePublish && !beforePublish()) {
+            return false;
+        }
+        // The history and rollups belong to the bins being replaced
+        for (size_t i = 0; i < shards_.size(); i++) {
+            publish(*shards_[i], std::move(versions[i]));
+            shards_[i]->history.clear();
+            shards_[i]->rollups.clear();
+        }
+        if (g_historyArchive.isOpen()) {
+            g_historyArchive.clear();
+        }
+
+        // Update next id to avoid ID collisions, also with deleted bins
+        const int64_t reserved = std::min<int64_t>(bins.reservedIds(), std::numeric_limits<int>::max());
+        nextId_ = std::max(*std::max_element(maxIds.begin(), maxIds.end()) + 1, static_cast<int>(reserved));
+        return true;
+    }
+
+    size_t size() const {
+        return read([](const BinSnapshot& bins) { return bins.size(); });
+    }
+
+    const FillHistory& historyForId(int id) const {
+        return shards_[shardForId(id)]->history;
+    }
+
+    FillRollups& rollups(size_t shard) {
+        return shards_[shard]->rollups;
+    }
+
+    const FillRollups& rollups(size_t shard) const {
+        return shards_[shard]->rollups;
+    }
+
+    // Persist every shard's unsealed history (at shutdown)
+    void sealHistory() {
+        for (auto& shard : shards_) {
+            shard->history.sealAll();
+        }
+    }
+
+    FillHistory::Usage historyUsage() const {
+        FillHistory::Usage total;
+        for (const auto& shard : shards_) {
+            FillHistory::Usage usage = shard->history.usage();
+            total.bins += usage.bins;
+            total.samples += usage.samples;
+            total.bytes += usage.bytes;
+        }
+        return total;
+    }
+
+private:
+    // Publishes the writer's version when write() finishes, including when
+    // fn returns early after a partial change
+    struct Publisher {
+        BinStore& store;
+        BinShard& shard;
+        ShardWriter& writer;
+        CommitTicket& ticket;
+        Publisher(BinStore& st, BinShard& sh, ShardWriter& w, CommitTicket& t)
+            : store(st), shard(sh), writer(w), ticket(t) {}
+        ~Publisher() {
+            if (writer.changed()) {
+                store.publish(shard, writer.build());
+            }
+            if (writer.journalSeq() != 0) {
+                ticket.segments.emplace_back(&writer.durableSegment(), writer.journalSeq());
+            }
+        }
+    };
+
+    // Caller holds the shard's writeMutex (or is init). shard.current owns
+    // the published version; the previous one is released once no reader is
+    // pinned in an epoch that could still see it.
+    void publish(BinShard& shard, std::shared_ptr<const ShardVersion> version) {
+        std::shared_ptr<const ShardVersion> previous = std::move(shard.current);
+        shard.current = std::move(version);
+        shard.published.store(shard.current.get(), std::memory_order_seq_cst);
+        if (previous != nullptr) {
+            epochs_.retire([previous]() mutable { previous.reset(); });
+        }
+    }
+
+    std::vector<std::unique_ptr<BinShard>> shards_;
+    MappedBinTable* table_ = nullptr;
+    mutable EpochManager epochs_;
+    ScanPool pool_;
+    std::atomic<int> nextId_{1};
+};
+
+// Global variables
+BinStore g_store;
+
+// Helper: Does the client want to wait until its change is on disk?
+// Opt in per request with ?ack=durable; otherwise the configured
+// durability mode decides when the change is synced.
+bool wantsDurableAck(const httplib::Request& req) {
+    return req.has_param("ack") && req.get_param_value("ack") == "durable";
+}
+
+// Helper: Finish persisting a mutation journaled under the shard locks,
+// honouring the durability policy and the request's acknowledgement mode.
+// Returns false if a change the caller waits for could not be synced.
+bool commitMutation(const CommitTicket& ticket, bool waitForDisk) {
+    bool ok = true;
+    for (const auto& segment : ticket.segments) {
+        ok = g_flusher.commit(*segment.first, segment.second, waitForDisk) && ok;
+    }
+    return ok;
+}
+
+// Helper: As above for an HTTP mutation; on a failure the response is set
+// to an error and false is returned: 503 once storage has stopped accepting
+// writes (see refuseWrites), 500 for a write that may still be retried
+bool commitMutation(const httplib::Request& req, const CommitTicket& ticket, httplib::Response& res) {
+    if (commitMutation(ticket, wantsDurableAck(req))) {
+        return true;
+    }
+    res.status = g_flusher.failed() ? 503 : 500;
+    res.set_content(
+        createApiResponse(false, "Change applied but could not be written to disk"),
+        "application/json"
+    );
+    return false;
+}
+
+// Helper: Refuse a mutation once a segment has failed (see DurableSegment).
+// Sets a 503 response and returns true if refused.
+bool refuseWrites(httplib::Response& res) {
+    if (!g_flusher.failed()) {
+        return false;
+    }
+    res.status = 503;
+    res.set_content(
+        createApiResponse(false, "Storage failed; writes are disabled until the server restarts"),
+        "application/json"
+    );
+    return true;
+}
+
+// Selection for GET /bins, parsed from the query string:
+//   cursor=<id>              resume after the bin with this id (the nextCursor
+//                            of the previous page); ids are never reused, so a
+//                            cursor stays valid across inserts and deletes
+//   limit=<n>                at most n bins per response (default: all)
+//   needsCollection=true|false
+//   minFill=<n>, maxFill=<n> inclusive fillLevel range
+//   updatedSince=<iso>       lastUpdated >= value
+//   updatedBefore=<iso>      lastUpdated <  value
+//   fields=id,fillLevel,...  project each bin onto these fields
+// Filters and projection are applied while the snapshot is scanned.
+struct BinQuery {
+    int afterId = 0;
+    size_t limit = SIZE_MAX;
+    int needsCollection = -1;  // -1: either, 0: false, 1: true
+    int minFill = 0;
+    int maxFill = 100;
+    int64_t updatedSince = INT64_MIN;
+    int64_t updatedBefore = INT64_MAX;
+    unsigned fields = WasteBin::ALL_FIELDS;
+
+    // Parse the query parameters; on failure returns false with a message
+    static bool parse(const httplib::Request& req, BinQuery& query, std::string& error) {
+        auto readInt = [&](const char* name, int& out, int minValue) {
+            if (!req.has_param(name)) {
+                return true;
+            }
+            const std::string value = req.get_param_value(name);
+            try {
+                size_t used = 0;
+                int parsed = std::stoi(value, &used);
+                if (used == value.size() && parsed >= minValue) {
+                    out = parsed;
+                    return true;
+                }
+            } catch (const std::exception&) {
+            }
+            error = std::string("Invalid ") + name + ": " + value;
+            return false;
+        };
+
+        int limit = 0;
+        if (!readInt("cursor", query.afterId, 0) ||
+            !readInt("limit", limit, 1) ||
+            !readInt("minFill", query.minFill, 0) ||
+            !readInt("maxFill", query.maxFill, 0)) {
+            return false;
+        }
+        if (limit > 0) {
+            query.limit = static_cast<size_t>(limit);
+        }
+
+        if (req.has_param("needsCollection")) {
+            const std::string value = req.get_param_value("needsCollection");
+            if (value == "true") {
+                query.needsCollection = 1;
+            } else if (value == "false") {
+                query.needsCollection = 0;
+            } else {
+                error = "Invalid needsCollection: " + value;
+                return false;
+            }
+        }
+
+        auto readTimestamp = [&](const char* name, int64_t& out) {
+            if (!req.has_param(name)) {
+                return true;
+            }
+            const std::string value = req.get_param_value(name);
+            if (!parseTimestamp(value, out)) {
+                error = std::string("Invalid ") + name + ": " + value;
+                return false;
+            }
+            return true;
+        };
+        if (!readTimestamp("updatedSince", query.updatedSince) ||
+            !readTimestamp("updatedBefore", query.updatedBefore)) {
+            return false;
+        }
+
+        if (req.has_param("fields")) {
+            static const std::map<std::string, unsigned> names = {
+                {"id", WasteBin::FIELD_ID},
+                {"location", WasteBin::FIELD_LOCATION},
+                {"fillLevel", WasteBin::FIELD_FILL_LEVEL},
+                {"needsCollection", WasteBin::FIELD_NEEDS_COLLECTION},
+                {"lastUpdated", WasteBin::FIELD_LAST_UPDATED}
+            };
+            query.fields = 0;
+            std::stringstream list(req.get_param_value("fields"));
+            std::string name;
+            while (std::getline(list, name, ',')) {
+                auto it = names.find(name);
+                if (it == names.end()) {
+                    error = "Unknown field: " + name;
+                    return false;
+                }
+                query.fields |= it->second;
+            }
+            if (query.fields == 0) {
+                error = "fields must name at least one field";
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Does the query narrow the result beyond "every bin"?
+    bool selective() const {
+        return afterId > 0 || limit != SIZE_MAX || needsCollection >= 0 ||
+               minFill > 0 || maxFill < 100 || updatedSince != INT64_MIN || updatedBefore != INT64_MAX;
+    }
+
+    bool matches(const BinTable::Row& bin) const {
+        return bin.id() > afterId &&
+               (needsCollection < 0 || bin.needsCollection() == (needsCollection == 1)) &&
+               bin.fillLevel() >= minFill && bin.fillLevel() <= maxFill &&
+               bin.lastUpdatedMs() >= updatedSince && bin.lastUpdatedMs() < updatedBefore;
+    }
+};
+
+// Selection for GET /bins/{id}/history, parsed from the query string:
+//   from=<iso>          samples taken at or after this time
+//   to=<iso>            samples taken before this time
+//   interval=<seconds>  downsample into buckets of this width (a whole
+//                       number of seconds), aligned to the epoch, reporting
+//                       min/max/avg/last per bucket
+struct HistoryQuery {
+    int64_t from = INT64_MIN;
+    int64_t to = INT64_MAX;
+    int intervalSeconds = 0;  // As requested, echoed in the response
+    int64_t intervalMs = 0;   // 0: raw samples
+
+    // Parse the query parameters; on failure returns false with a message
+    static bool parse(const httplib::Request& req, HistoryQuery& query, std::string& error) {
+        auto readTimestamp = [&](const char* name, int64_t& out) {
+            if (!req.has_param(name)) {
+                return true;
+            }
+            const std::string value = req.get_param_value(name);
+            if (!parseTimestamp(value, out)) {
+                error = std::string("Invalid ") + name + ": " + value;
+                return false;
+            }
+            return true;
+        };
+        if (!readTimestamp("from", query.from) || !readTimestamp("to", query.to)) {
+            return false;
+        }
+
+        if (req.has_param("interval")) {
+            // Digits only: no sign, spaces, fraction or unit, so the width
+            // is exactly what the client asked for
+            const std::string value = req.get_param_value("interval");
+            const bool digits = !value.empty() && std::all_of(value.begin(), value.end(), ::isdigit);
+            try {
+                int seconds = digits ? std::stoi(value) : 0;
+                if (seconds >= 1) {
+                    query.intervalSeconds = seconds;
+                    query.intervalMs = static_cast<int64_t>(seconds) * 1000;
+                    return true;
+                }
+            } catch (const std::exception&) {
+            }
+            error = "Invalid interval: " + value + " (whole seconds expected)";
+            return false;
+        }
+        return true;
+    }
+};
+
+// Serialized bytes handed to the socket per chunk when streaming GET /bins
+constexpr size_t BIN_STREAM_BATCH_BYTES = 64 * 1024;
+
+// Helper: Stream the bins of a snapshot selected by a query as the
+// createApiResponse envelope, in fixed-size batches of pages, so the full
+// body is never held in memory at once. The snapshot owns its shard
+// versions, so writers keep publishing meanwhile. When the limit cuts the
+// scan short, the envelope carries a nextCursor for the following page.
+void streamBinsResponse(httplib::Response& res, BinSnapshot snapshot, const BinQuery& query) {
+    struct StreamState {
+        StreamState(BinSnapshot bins, const BinQuery& query) : bins(std::move(bins)), query(query) {}
+
+        BinSnapshot bins;
+        BinQuery query;
+        size_t page = 0;
+        size_t emitted = 0;
+        int lastId = 0;
+        bool opened = false;
+        bool truncated = false;
+        bool finished = false;
+        std::string buffer;
+        std::vector<BinTable::Row> selected;
+    };
+
+    auto state = std::make_shared<StreamState>(std::move(snapshot), query);
+    // Pages hold 64 consecutive ids, so resuming from a cursor skips straight
+    // to the page holding the next id (computed unsigned: the cursor may be
+    // INT_MAX)
+    state->page = (static_cast<unsigned>(query.afterId) + 1) / BIN_PAGE_SPAN;
+    state->buffer.reserve(BIN_STREAM_BATCH_BYTES + 1024);
+
+    res.set_chunked_content_provider(
+        "application/json",
+        [state](size_t, httplib::DataSink& sink) {
+            if (state->finished) {
+                return true;
+            }
+
+            const BinQuery& query = state->query;
+            const size_t pageCount = state->bins.globalPageCount();
+            std::string& out = state->buffer;
+            out.clear();
+            if (!state->opened) {
+                out += "{\"data\":[";
+                state->opened = true;
+            }
+
+            while (state->page < pageCount && !state->truncated && out.size() < BIN_STREAM_BATCH_BYTES) {
+                if (const BinTable* table = state->bins.pageAt(state->page)) {
+                    // Concurrent inserts may land in a page out of id order;
+                    // sort the page's matches so cursors never skip a bin
+                    auto& selected = state->selected;
+                    selected.clear();
+                    forEachFillMatch(*table, query.minFill, query.maxFill, query.needsCollection,
+                                     [&](const BinTable::Row& bin) {
+                        if (query.matches(bin)) {
+                            selected.push_back(bin);
+                        }
+                    });
+                    std::sort(selected.begin(), selected.end(),
+                              [](const BinTable::Row& a, const BinTable::Row& b) { return a.id() < b.id(); });
+
+                    for (const auto& bin : selected) {
+                        if (state->emitted == query.limit) {
+                            state->truncated = true;
+                            break;
+                        }
+                        if (state->emitted > 0) {
+                            out += ',';
+                        }
+                        bin.appendJson(out, query.fields);  // Cached fragment when unprojected
+                        state->lastId = bin.id();
+                        ++state->emitted;
+                    }
+                }
+                if (!state->truncated) {
+                    ++state->page;
+                }
+                if (state->emitted == query.limit && state->page < pageCount) {
+                    state->truncated = true;
+                }
+            }
+
+            if (state->truncated || state->page >= pageCount) {
+                // Keys in the order nlohmann::json emits them for the envelope
+                std::string message;
+                if (state->emitted > 0) {
+                    message = "Retrieved " + std::to_string(state->emitted) + " bins";
+                } else {
+                    message = query.selective() ? "No matching bins" : "No bins available";
+                }
+                out += "],\"message\":";
+                appendJsonString(out, message);
+                if (state->truncated) {
+                    out += ",\"nextCursor\":";
+                    appendJsonInt(out, state->lastId);
+                }
+                out += ",\"success\":true}";
+                state->finished = true;
+            }
+
+            if (!sink.write(out.data(), out.size())) {
+                return false;
+            }
+            if (state->finished) {
+                sink.done();
+            }
+            return true;
+        });
+}
+
+// Most readings accepted by one POST /bins/readings request
+const size_t MAX_READINGS_PER_REQUEST = 50000;
+
+// How far a sensor clock may run ahead of the server's; a reading stamped
+// later than that is rejected, as it would make every later reading stale
+const int64_t MAX_SENSOR_CLOCK_SKEW_MS = 5 * 60 * 1000;
+
+// One fill-level reading pushed by a gateway, and what became of it.
+//
+// A reading is stale when it is older than the bin's lastUpdated, which is
+// the newest sensor timestamp applied or, after PUT /bins/{id} or
+// /bins/collect-sensor-data, the server clock at that change. A sensor whose
+// clock runs behind the server's therefore has its readings reported stale
+// until its clock passes the time of the manual update.
+struct SensorReading {
+    enum Status { INVALID, UPDATED, NOT_FOUND, STALE };
+
+    int binId = 0;
+    bool hasBinId = false;
+    int fillLevel = 0;
+    int64_t timestamp = 0;  // Epoch milliseconds, sensor clock
+    Status status = INVALID;
+    std::string error;
+
+    static const char* statusName(Status status) {
+        switch (status) {
+            case INVALID: return "invalid";
+            case UPDATED: return "updated";
+            case NOT_FOUND: return "not_found";
+            case STALE: return "stale";
+        }
+        return "unknown";
+    }
+
+    // Check a parsed timestamp; on failure sets error and returns false
+    bool checkTimestamp(int64_t now) {
+        if (timestamp < 0) {
+            error = "sensorTimestamp is before the epoch";
+        } else if (timestamp > now + MAX_SENSOR_CLOCK_SKEW_MS) {
+            error = "sensorTimestamp is in the future";
+        } else {
+            return true;
+        }
+        status = INVALID;
+        return false;
+    }
+
+    // Check and set a decoded bin id; on failure sets error and returns false
+    bool setBinId(double id) {
+        if (id < 1 || id > std::numeric_limits<int>::max()) {
+            error = "binId is out of range";
+            status = INVALID;
+            return false;
+        }
+        binId = static_cast<int>(id);
+        hasBinId = true;
+        return true;
+    }
+
+    void setFillLevel(double level) {
+        fillLevel = static_cast<int>(std::max(0.0, std::min(100.0, level)));
+    }
+
+    // Validate one item; a bad item is marked INVALID rather than failing
+    // the batch. sensorTimestamp is optional and may be an ISO 8601 string
+    // or epoch milliseconds. Fill levels are clamped to 0..100.
+    static SensorReading parse(const json& item, int64_t now) {
+        SensorReading reading;
+        reading.timestamp = now;
+        if (!item.is_object()) {
+            reading.error = "reading must be an object";
+            return reading;
+        }
+
+        auto binId = item.find("binId");
+        if (binId == item.end() || !binId->is_number_integer()) {
+            reading.error = "binId must be an integer";
+            return reading;
+        }
+        if (!reading.setBinId(binId->get<double>())) {
+            return reading;
+        }
+
+        auto fillLevel = item.find("fillLevel");
+        if (fillLevel == item.end() || !fillLevel->is_number()) {
+            reading.error = "fillLevel must be a number";
+            return reading;
+        }
+        reading.setFillLevel(fillLevel->get<double>());
+
+        auto timestamp = item.find("sensorTimestamp");
+        if (timestamp != item.end()) {
+            if (timestamp->is_number_unsigned() && timestamp->get<uint64_t>() > static_cast<uint64_t>(INT64_MAX)) {
+                reading.timestamp = INT64_MAX;  // Fails checkTimestamp() below
+            } else if (timestamp->is_number_integer()) {
+                reading.timestamp = timestamp->get<int64_t>();
+            } else if (!timestamp->is_string() || !parseTimestamp(timestamp->get<std::string>(), reading.timestamp)) {
+                reading.error = "sensorTimestamp must be an ISO 8601 string or epoch milliseconds";
+                return reading;
+            }
+            if (!reading.checkTimestamp(now)) {
+                return reading;
+            }
+        }
+
+        reading.status = UPDATED;  // Until the store says otherwise
+        return reading;
+    }
+
+    void appendJson(std::string& out) const {
+        out += '{';
+        if (hasBinId) {
+            out += "\"binId\":";
+            appendJsonInt(out, binId);
+            out += ',';
+        }
+        if (status == INVALID) {
+            out += "\"error\":";
+            appendJsonString(out, error);
+            out += ',';
+        }
+        out += "\"status\":";
+        appendJsonString(out, statusName(status));
+        out += '}';
+    }
+};
+
+// Helper: Apply a batch of parsed readings with one write (and one journal
+// append) per shard, shards in parallel. Each reading's status is updated in
+// place; the caller commits the ticket under its acknowledgement mode.
+void applySensorReadings(std::vector<SensorReading>& readings, CommitTicket& ticket) {
+    // Route the valid readings to their shards, keeping request order
+    std::vector<std::vector<size_t>> byShard(g_store.shardCount());
+    for (size_t i = 0; i < readings.size(); i++) {
+        if (readings[i].status != SensorReading::INVALID) {
+            byShard[g_store.shardForId(readings[i].binId)].push_back(i);
+        }
+    }
+
+    // One write (and one journal append) per shard, shards in parallel
+    std::vector<CommitTicket> tickets(g_store.shardCount());
+    g_store.parallelForShards([&](size_t index) {
+        if (byShard[index].empty()) {
+            return;
+        }
+
+        g_store.write(index, tickets[index], [&](ShardWriter& shard) {
+            std::vector<json> records;
+            records.reserve(byShard[index].size());
+            for (size_t i : byShard[index]) {
+                SensorReading& reading = readings[i];
+                BinTable::RowRef bin = shard.find(reading.binId);
+                if (!bin) {
+                    reading.status = SensorReading::NOT_FOUND;
+                    continue;
+                }
+                if (reading.timestamp < bin.lastUpdatedMs()) {
+                    reading.status = SensorReading::STALE;
+                    continue;
+                }
+
+                bin.setFillLevel(reading.fillLevel);
+                bin.setNeedsCollection(reading.fillLevel >= COLLECTION_THRESHOLD);
+                bin.setLastUpdated(reading.timestamp);
+                shard.recordSample(bin);
+                records.push_back(journalUpdateRecord(bin, {
+                    {"fillLevel", bin.fillLevel()},
+                    {"needsCollection", bin.needsCollection()}
+                }));
+            }
+
+            shard.journal(records);
+        });
+    });
+
+    for (const auto& shardTicket : tickets) {
+        ticket.segments.insert(ticket.segments.end(), shardTicket.segments.begin(), shardTicket.segments.end());
+    }
+}
+
+// One journal record, decoded and validated ahead of replay
+struct JournalEntry {
+    enum Op { ADD, UPDATE, DELETE };
+
+    Op op;
+    int id;
+    unsigned fields = 0;  // WasteBin::Field bits present in bin
+    WasteBin bin;
+};
+
+// Helper: Decode a journal record; throws if it is malformed
+JournalEntry parseJournalEntry(const json& record) {
+    JournalEntry entry;
+    const std::string op = record.at("op").get<std::string>();
+    entry.id = record.at("id").get<int>();
+
+    if (op == "delete") {
+        entry.op = JournalEntry::DELETE;
+        return entry;
+    }
+
+    const json& fields = record.at("fields");
+
+    if (op == "add") {
+        json full = fields;
+        full["id"] = entry.id;
+        entry.op = JournalEntry::ADD;
+        entry.bin = WasteBin::fromJson(full);
+        entry.fields = WasteBin::ALL_FIELDS;
+        return entry;
+    }
+
+    if (op == "update") {
+        entry.op = JournalEntry::UPDATE;
+        if (fields.contains("location")) {
+            entry.bin.location = fields["location"].get<std::string>();
+            entry.fields |= WasteBin::FIELD_LOCATION;
+        }
+        if (fields.contains("fillLevel")) {
+            entry.bin.fillLevel = fields["fillLevel"].get<int>();
+            entry.fields |= WasteBin::FIELD_FILL_LEVEL;
+        }
+        if (fields.contains("needsCollection")) {
+            entry.bin.needsCollection = fields["needsCollection"].get<bool>();
+            entry.fields |= WasteBin::FIELD_NEEDS_COLLECTION;
+        }
+        if (fields.contains("lastUpdated")) {
+            entry.bin.lastUpdated = requireTimestamp(fields["lastUpdated"].get<std::string>());
+            entry.fields |= WasteBin::FIELD_LAST_UPDATED;
+        }
+        return entry;
+    }
+
+    throw std::runtime_error("unknown journal op '" + op + "'");
+}
+
+// Helper: Apply a single journal entry to a bin list
+void applyJournalEntry(BinTable& bins, const JournalEntry& entry) {
+    switch (entry.op) {
+        case JournalEntry::DELETE:
+            bins.erase(entry.id);
+            return;
+
+        case JournalEntry::ADD:
+            bins.insert(entry.bin);
+            return;
+
+        case JournalEntry::UPDATE: {
+            BinTable::RowRef it = bins.find(entry.id);
+            if (!it) {
+                return;  // Bin was deleted later in the log
+            }
+            if (entry.fields & WasteBin::FIELD_LOCATION) it.setLocation(entry.bin.location);
+            if (entry.fields & WasteBin::FIELD_FILL_LEVEL) it.setFillLevel(entry.bin.fillLevel);
+            if (entry.fields & WasteBin::FIELD_NEEDS_COLLECTION) it.setNeedsCollection(entry.bin.needsCollection);
+            if (entry.fields & WasteBin::FIELD_LAST_UPDATED) it.setLastUpdated(entry.bin.lastUpdated);
+            return;
+        }
+    }
+}
+
+// Helper: Decode a journal file. A torn final line (crash mid-append), or
+// any bad line, ends the file instead of failing the load.
+std::vector<JournalEntry> readJournal(const std::string& path) {
+    std::vector<JournalEntry> entries;
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return entries;
+    }
+
+    size_t lineNo = 0;
+    std::string line;
+    while (std::getline(file, line)) {
+        lineNo++;
+        if (line.empty()) {
+            continue;
+        }
+
+        try {
+            entries.push_back(parseJournalEntry(json::parse(line)));
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Stopping replay of " << path << " at line " << lineNo << ": " << e.what() << std::endl;
+            break;
+        }
+    }
+
+    return entries;
+}
+
+// A fill reading applied by the journal replay; loadRollups adds the ones
+// the saved rollups are missing
+struct ReplayedReading {
+    int id;
+    int64_t timestamp;
+    int fillLevel;
+};
+
+// Helper: Replay journal files on top of the loaded snapshot.
+//
+// The files are decoded in parallel, and each file's entries are split by
+// shard as it is decoded. Each entry's sequence number is its position in
+// replay order (file, then line), and every shard then applies its own
+// entries in that order, in parallel with the other shards, so the last
+// write to a bin wins exactly as in a serial replay. Entries for one id
+// always land in the same shard, whichever file they came from.
+size_t replayJournals(ShardedBins& bins, const std::vector<std::string>& replayOrder,
+                      std::vector<ReplayedReading>* readings = nullptr) {
+    std::vector<std::vector<JournalEntry>> files(replayOrder.size());
+    std::vector<std::vector<std::vector<size_t>>> owned(replayOrder.size());  // File -> shard -> entries
+    g_store.parallelFor(replayOrder.size(), [&](size_t i) {
+        files[i] = readJournal(replayOrder[i]);
+        owned[i].resize(bins.shardCount());
+        for (size_t entry = 0; entry < files[i].size(); entry++) {
+            owned[i][bins.shardForId(files[i][entry].id)].push_back(entry);
+        }
+    });
+
+    // Ids seen in any record stay reserved, even if the bin was deleted
+    std::vector<int> maxIds(bins.shardCount(), 0);
+    std::vector<std::vector<ReplayedReading>> shardReadings(bins.shardCount());
+    g_store.parallelFor(bins.shardCount(), [&](size_t shard) {
+        BinTable& part = bins.part(shard);
+        const BinTable& view = part;
+        for (size_t file = 0; file < files.size(); file++) {
+            for (size_t index : owned[file][shard]) {
+                const JournalEntry& entry = files[file][index];
+                int64_t timestamp = 0;
+                int fillLevel = -1;
+                if (BinTable::Row before = view.find(entry.id)) {
+                    timestamp = before.lastUpdatedMs();
+                    fillLevel = before.fillLevel();
+                }
+                applyJournalEntry(part, entry);
+                maxIds[shard] = std::max(maxIds[shard], entry.id);
+
+                // Same test as ShardWriter::isNewReading
+                BinTable::Row after = view.find(entry.id);
+                if (readings != nullptr && after &&
+                    (after.lastUpdatedMs() != timestamp || after.fillLevel() != fillLevel)) {
+                    shardReadings[shard].push_back({entry.id, after.lastUpdatedMs(), after.fillLevel()});
+                }
+            }
+        }
+    });
+    if (readings != nullptr) {
+        for (auto& part : shardReadings) {
+            readings->insert(readings->end(), part.begin(), part.end());
+        }
+    }
+
+    size_t replayed = 0;
+    for (const auto& entries : files) {
+        replayed += entries.size();
+    }
+    for (int id : maxIds) {
+        bins.reserveIds(static_cast<int64_t>(id) + 1);
+    }
+    return replayed;
+}
+
+// Helper: Directory holding DATA_FILE and the journal segments
+std::string dataDirectory() {
+    std::string::size_type slash = DATA_FILE.find_last_of('/');
+    return slash == std::string::npos ? "." : DATA_FILE.substr(0, slash);
+}
+
+// Journal files found on disk
+struct JournalFileSet {
+    // Replay order: each segment's rotated (.compacting) part before its
+    // live part. Segments are independent because an id always maps to
+    // the same shard for a given shard count; that only holds while every
+    // segment was written with one layout, so startup folds them all into
+    // a snapshot whenever the shard count changes.
+    std::vector<std::string> replayOrder;
+
+    // Files no current segment writer owns (an unsharded journal or
+    // segments from a run with more shards); compaction removes them
+    std::vector<std::string> stale;
+};
+
+JournalFileSet findJournalFiles(size_t shardCount) {
+    std::string dir = dataDirectory();
+    std::string::size_type slash = JOURNAL_FILE.find_last_of('/');
+    std::string base = slash == std::string::npos ? JOURNAL_FILE : JOURNAL_FILE.substr(slash + 1);
+    std::string prefix = dir + "/";
+
+    std::vector<std::string> legacy;
+    std::map<size_t, std::pair<std::string, std::string>> segments;  // shard -> (compacting, live)
+
+    if (DIR* handle = ::opendir(dir.c_str())) {
+        while (dirent* entry = ::readdir(handle)) {
+            std::string name = entry->d_name;
+            if (name == base || name == base + ".compacting") {
+                legacy.push_back(prefix + name);
+                continue;
+            }
+            if (name.compare(0, base.size() + 1, base + ".") != 0) {
+                continue;
+            }
+
+            std::string rest = name.substr(base.size() + 1);
+            bool compacting = rest.size() > 11 && rest.compare(rest.size() - 11, 11, ".compacting") == 0;
+            std::string digits = compacting ? rest.substr(0, rest.size() - 11) : rest;
+            if (digits.empty() || !std::all_of(digits.begin(), digits.end(), ::isdigit)) {
+                continue;
+            }
+
+            auto& segment = segments[std::stoul(digits)];
+            (compacting ? segment.first : segment.second) = prefix + name;
+        }
+        ::closedir(handle);
+    }
+
+    JournalFileSet files;
+    std::sort(legacy.begin(), legacy.end(), [](const std::string& a, const std::string& b) {
+        return a.size() > b.size();  // ".compacting" before the live file
+    });
+    for (const auto& path : legacy) {
+        files.replayOrder.push_back(path);
+        files.stale.push_back(path);
+    }
+    for (const auto& segment : segments) {
+        for (const std::string* path : {&segment.second.first, &segment.second.second}) {
+            if (!path->empty()) {
+                files.replayOrder.push_back(*path);
+                if (segment.first >= shardCount) {
+                    files.stale.push_back(*path);
+                }
+            }
+        }
+    }
+    return files;
+}
+
+// Binary snapshot layout (version 1, little-endian):
+//   SnapshotHeader
+//   recordCount fixed-width SnapshotRecords, in snapshot order
+//   stringCount + 1 uint32 offsets into the string bytes
+//   stringBytes bytes of location text, each distinct location stored once
+// The checksum covers everything after the header. Loading maps the file
+// and copies the columns out without parsing any text. shardCount records
+// the journal segment layout the snapshot was cut with and nextId the lowest
+// id never handed out (0 if unknown, in snapshots that predate them).
+const char SNAPSHOT_MAGIC[8] = {'S', 'M', 'W', 'S', 'S', 'N', 'A', 'P'};
+const uint32_t SNAPSHOT_VERSION = 1;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint64_t stringCount;
+    uint64_t stringBytes;
+    uint64_t checksum;
+    uint64_t shardCount;
+    uint64_t nextId;
+};
+
+struct SnapshotRecord {
+    int64_t lastUpdated;        // Epoch milliseconds
+    int32_t id;
+    uint32_t location;          // Index into the string table
+    uint8_t fillLevel;
+    uint8_t needsCollection;
+    uint8_t reserved[6];
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header layout changed");
+static_assert(sizeof(SnapshotRecord) == 24, "snapshot record layout changed");
+// Helper: Encode bins as a binary snapshot. forEachBin(fn) must call
+// fn(const BinTable::Row&) once per bin; nextId is the id allocator's
+// high-water mark.
+template <typename ForEachBin>
+std::string encodeBinarySnapshot(ForEachBin&& forEachBin, int64_t nextId) {
+    std::vector<SnapshotRecord> records;
+    std::vector<uint32_t> stringIndex;  // Location handle -> string table index
+    std::vector<uint32_t> offsets{0};
+    std::string strings;
+
+    forEachBin([&](const BinTable::Row& bin) {
+        const uint32_t handle = bin.locationHandle();
+        if (handle >= stringIndex.size()) {
+            stringIndex.resize(handle + 1, UINT32_MAX);
+        }
+        if (stringIndex[handle] == UINT32_MAX) {
+            stringIndex[handle] = static_cast<uint32_t>(offsets.size() - 1);
+            strings.append(bin.location());
+            offsets.push_back(static_cast<uint32_t>(strings.size()));
+        }
+
+        SnapshotRecord record{};
+        record.lastUpdated = bin.lastUpdatedMs();
+        record.id = bin.id();
+        record.location = stringIndex[handle];
+        record.fillLevel = static_cast<uint8_t>(bin.fillLevel());
+        record.needsCollection = bin.needsCollection() ? 1 : 0;
+        records.push_back(record);
+    });
+
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.recordSize = sizeof(SnapshotRecord);
+    header.recordCount = records.size();
+    header.stringCount = offsets.size() - 1;
+    header.stringBytes = strings.size();
+    header.shardCount = g_store.shardCount();
+    header.nextId = static_cast<uint64_t>(nextId);
+
+    std::string out;
+    out.reserve(sizeof(header) + records.size() * sizeof(SnapshotRecord) +
+                offsets.size() * sizeof(uint32_t) + strings.size());
+    out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(SnapshotRecord));
+    out.append(reinterpret_cast<const char*>(offsets.data()), offsets.size() * sizeof(uint32_t));
+    out += strings;
+
+    header.checksum = fnv1aChecksum(out.data() + sizeof(header), out.size() - sizeof(header));
+    std::memcpy(&out[0], &header, sizeof(header));
+    return out;
+}
+
+// Helper: Decode a binary snapshot into bins; throws if it is damaged
+void decodeBinarySnapshot(const char* data, size_t size, ShardedBins& bins) {
+    SnapshotHeader header;
+    if (size < sizeof(header)) {
+        throw std::runtime_error("snapshot is truncated");
+    }
+    std::memcpy(&header, data, sizeof(header));
+    if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        throw std::runtime_error("not a bin snapshot");
+    }
+    if (header.version != SNAPSHOT_VERSION || header.recordSize != sizeof(SnapshotRecord)) {
+        throw std::runtime_error("unsupported snapshot version " + std::to_string(header.version));
+    }
+
+    // Sizes are checked one by one so a corrupt count cannot overflow
+    size_t remaining = size - sizeof(header);
+    if (header.recordCount > remaining / sizeof(SnapshotRecord)) {
+        throw std::runtime_error("snapshot is truncated");
+    }
+    remaining -= header.recordCount * sizeof(SnapshotRecord);
+    if (header.stringCount >= remaining / sizeof(uint32_t)) {
+        throw std::runtime_error("snapshot is truncated");
+    }
+    remaining -= (header.stringCount + 1) * sizeof(uint32_t);
+    if (header.stringBytes != remaining) {
+        throw std::runtime_error("snapshot size does not match its header");
+    }
+    if (fnv1aChecksum(data + sizeof(header), size - sizeof(header)) != header.checksum) {
+        throw std::runtime_error("snapshot checksum mismatch");
+    }
+
+    bins.reserveIds(static_cast<int64_t>(std::min<uint64_t>(header.nextId, INT64_MAX)));
+
+    const char* records = data + sizeof(header);
+    const char* offsets = records + header.recordCount * sizeof(SnapshotRecord);
+    const char* strings = offsets + (header.stringCount + 1) * sizeof(uint32_t);
+
+    // Intern each distinct location once; records then refer to handles
+    std::vector<uint32_t> handles(header.stringCount);
+    uint32_t begin;
+    std::memcpy(&begin, offsets, sizeof(begin));
+    for (size_t i = 0; i < header.stringCount; i++) {
+        uint32_t end;
+        std::memcpy(&end, offsets + (i + 1) * sizeof(uint32_t), sizeof(end));
+        if (begin > end || end > header.stringBytes) {
+            throw std::runtime_error("snapshot string table is corrupt");
+        }
+        handles[i] = g_locations.intern(std::string_view(strings + begin, end - begin));
+        begin = end;
+    }
+
+    // Split the records by shard once, a range of records per task, then
+    // let each shard insert its own records in snapshot order, in parallel
+    const size_t shards = bins.shardCount();
+    const size_t ranges = shards;
+    std::vector<std::vector<std::vector<size_t>>> owned(ranges, std::vector<std::vector<size_t>>(shards));
+    g_store.parallelFor(ranges, [&](size_t range) {
+        const size_t end = header.recordCount * (range + 1) / ranges;
+        for (size_t i = header.recordCount * range / ranges; i < end; i++) {
+            int32_t id;
+            std::memcpy(&id, records + i * sizeof(SnapshotRecord) + offsetof(SnapshotRecord, id), sizeof(id));
+            owned[range][bins.shardForId(id)].push_back(i);
+        }
+    });
+
+    g_store.parallelFor(shards, [&](size_t shard) {
+        BinTable& part = bins.part(shard);
+        size_t count = 0;
+        for (const auto& range : owned) {
+            count += range[shard].size();
+        }
+        part.reserve(count);
+        for (const auto& range : owned) {
+            for (size_t i : range[shard]) {
+                SnapshotRecord record;
+                std::memcpy(&record, records + i * sizeof(SnapshotRecord), sizeof(record));
+                if (record.location >= header.stringCount) {
+                    throw std::runtime_error("snapshot record " + std::to_string(i) + " has no location");
+                }
+                part.insert(record.id, handles[record.location], record.fillLevel, record.needsCollection != 0,
+                            record.lastUpdated);
+            }
+        }
+    });
+}
+
+// Helper: Map a binary snapshot and load it into bins. Returns false if the
+// file does not exist; throws if it cannot be read or is damaged.
+bool loadBinarySnapshot(const std::string& path, ShardedBins& bins) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return false;
+        }
+        throw std::runtime_error("cannot open " + path + ": " + std::strerror(errno));
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0) {
+        int error = errno;
+        ::close(fd);
+        throw std::runtime_error("cannot stat " + path + ": " + std::strerror(error));
+    }
+    const size_t size = static_cast<size_t>(info.st_size);
+    if (size == 0) {
+        ::close(fd);
+        throw std::runtime_error(path + " is empty");
+    }
+
+    void* mapped = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED) {
+        throw std::runtime_error("cannot map " + path + ": " + std::strerror(errno));
+    }
+    std::unique_ptr<void, std::function<void(void*)>> unmap(mapped, [size](void* p) { ::munmap(p, size); });
+    ::madvise(mapped, size, MADV_SEQUENTIAL);
+
+    decodeBinarySnapshot(static_cast<const char*>(mapped), size, bins);
+    return true;
+}
+
+// Helper: Shard count the snapshot at path was cut with; 0 if there is no
+// snapshot or it predates the field
+uint64_t snapshotShardCount(const std::string& path) {
+    SnapshotHeader header{};
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    bool ok = ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header));
+    ::close(fd);
+    if (!ok || std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        return 0;
+    }
+    return header.shardCount;
+}
+
+// Outcome of a JSON import: bins loaded, records skipped and the first few
+// reasons, for the log and the import response
+struct JsonImport {
+    static constexpr size_t MAX_ERRORS = 20;
+
+    size_t imported = 0;
+    size_t skipped = 0;
+    std::vector<std::string> errors;
+    std::string failure;  // Why the import as a whole failed
+
+    void skip(const std::string& path, size_t index, const std::string& reason) {
+        skipped++;
+        if (errors.size() < MAX_ERRORS) {
+            errors.push_back("bin #" + std::to_string(index) + ": " + reason);
+            std::cerr << "Skipping bin #" << index << " in " << path << ": " << reason << std::endl;
+        }
+    }
+};
+
+// SAX handler for a JSON array of bins. Each WasteBin is built straight
+// from the parser events, so no DOM of the whole file is ever held. A record
+// with a missing or mistyped field is skipped and reported; the others still
+// load. Syntax errors stop the import.
+class BinImportHandler : public json::json_sax_t {
+public:
+    static constexpr size_t PROGRESS_INTERVAL = 100000;
+
+    BinImportHandler(const std::string& path, std::istream& in, std::streamoff size, ShardedBins& bins, JsonImport& report)
+        : path_(path), in_(in), size_(size), bins_(bins), report_(report) {}
+
+    const std::string& failure() const { return failure_; }
+
+    bool null() override { return scalar(NONE); }
+    bool boolean(bool value) override {
+        if (!scalar(FIELD_NEEDS_COLLECTION)) return false;
+        if (assigning(FIELD_NEEDS_COLLECTION)) bin_.needsCollection = value;
+        return true;
+    }
+    bool number_integer(number_integer_t value) override { return number(static_cast<double>(value)); }
+    bool number_unsigned(number_unsigned_t value) override { return number(static_cast<double>(value)); }
+    bool number_float(number_float_t value, const string_t&) override { return number(value); }
+    bool string(string_t& value) override {
+        if (!scalar(field_ == FIELD_LAST_UPDATED ? FIELD_LAST_UPDATED : FIELD_LOCATION)) return false;
+        if (assigning(FIELD_LOCATION)) {
+            bin_.location = std::move(value);
+        } else if (assigning(FIELD_LAST_UPDATED) && !parseTimestamp(value, bin_.lastUpdated) && error_.empty()) {
+            error_ = "lastUpdated is not a valid timestamp";
+        }
+        return true;
+    }
+    bool binary(binary_t&) override { return scalar(NONE); }
+
+    bool start_object(std::size_t) override {
+        if (depth_ == 0) {
+            return topLevelError();
+        }
+        if (depth_ == 1) {
+            beginRecord();
+            inRecord_ = true;
+        } else if (depth_ == 2 && inRecord_) {
+            wrongType();
+        }
+        depth_++;
+        return true;
+    }
+
+    bool key(string_t& name) override {
+        if (depth_ == 2 && inRecord_) {
+            field_ = fieldNamed(name);
+        }
+        return true;
+    }
+
+    bool end_object() override {
+        depth_--;
+        if (depth_ == 1 && inRecord_) {
+            finishRecord();
+            inRecord_ = false;
+        }
+        return true;
+    }
+
+    bool start_array(std::size_t) override {
+        if (depth_ == 1) {
+            beginRecord();
+            report_.skip(path_, index_, "not an object");
+        } else if (depth_ == 2 && inRecord_) {
+            wrongType();
+        }
+        depth_++;
+        return true;
+    }
+
+    bool end_array() override {
+        depth_--;
+        return true;
+    }
+
+    bool parse_error(std::size_t position, const std::string&, const nlohmann::detail::exception& e) override {
+        failure_ = "syntax error at byte " + std::to_string(position) + ": " + e.what();
+        return false;
+    }
+
+private:
+    enum Field {
+        NONE,
+        FIELD_ID,
+        FIELD_LOCATION,
+        FIELD_FILL_LEVEL,
+        FIELD_NEEDS_COLLECTION,
+        FIELD_LAST_UPDATED
+    };
+
+    static Field fieldNamed(const std::string& name) {
+        if (name == "id") return FIELD_ID;
+        if (name == "location") return FIELD_LOCATION;
+        if (name == "fillLevel") return FIELD_FILL_LEVEL;
+        if (name == "needsCollection") return FIELD_NEEDS_COLLECTION;
+        if (name == "lastUpdated") return FIELD_LAST_UPDATED;
+        return NONE;
+    }
+
+    static const char* fieldName(Field field) {
+        static const char* names[] = {"", "id", "location", "fillLevel", "needsCollection", "lastUpdated"};
+        return names[field];
+    }
+
+    bool topLevelError() {
+        failure_ = "expected an array of bins";
+        return false;
+    }
+
+    // A scalar arrived; accepts is the field that scalar type can fill
+    bool scalar(Field accepts) {
+        if (depth_ == 0) {
+            return topLevelError();
+        }
+        if (depth_ == 1) {
+            beginRecord();
+            report_.skip(path_, index_, "not an object");
+        } else if (depth_ == 2 && inRecord_ && field_ != accepts) {
+            wrongType();
+        }
+        return true;
+    }
+
+    // Values outside int (or ids below 1) fail the record rather than wrap
+    bool number(double value) {
+        Field accepts = field_ == FIELD_FILL_LEVEL ? FIELD_FILL_LEVEL : FIELD_ID;
+        if (!scalar(accepts)) return false;
+        const double lowest = field_ == FIELD_ID ? 1 : std::numeric_limits<int>::min();
+        const bool inRange = value >= lowest && value <= std::numeric_limits<int>::max();
+        if (!inRange && depth_ == 2 && inRecord_ && field_ == accepts && error_.empty()) {
+            error_ = std::string(fieldName(field_)) + " is out of range";
+        }
+        if (assigning(FIELD_ID) && inRange) bin_.id = static_cast<int>(value);
+        if (assigning(FIELD_FILL_LEVEL) && inRange) bin_.fillLevel = static_cast<int>(value);
+        return true;
+    }
+
+    // Is the current value the given field of a record? Marks it as seen.
+    bool assigning(Field field) {
+        if (depth_ != 2 || !inRecord_ || field_ != field) {
+            return false;
+        }
+        seen_ |= 1u << field;
+        return true;
+    }
+
+    void wrongType() {
+        if (field_ != NONE && error_.empty()) {
+            error_ = std::string(fieldName(field_)) + " has the wrong type";
+        }
+    }
+
+    void beginRecord() {
+        bin_ = WasteBin();
+        seen_ = 0;
+        field_ = NONE;
+        error_.clear();
+        index_++;
+    }
+
+    void finishRecord() {
+        for (Field field : {FIELD_ID, FIELD_LOCATION, FIELD_FILL_LEVEL, FIELD_NEEDS_COLLECTION, FIELD_LAST_UPDATED}) {
+            if (error_.empty() && !(seen_ & (1u << field))) {
+                error_ = std::string("missing ") + fieldName(field);
+            }
+        }
+        if (!error_.empty()) {
+            report_.skip(path_, index_, error_);
+            return;
+        }
+
+        bins_.forId(bin_.id).insert(bin_);
+        if (++report_.imported % PROGRESS_INTERVAL == 0) {
+            std::streamoff position = in_.tellg();
+            std::cout << "Importing " << path_ << ": " << report_.imported << " bins";
+            if (size_ > 0 && position >= 0) {
+                std::cout << " (" << position * 100 / size_ << "%)";
+            }
+            std::cout << std::endl;
+        }
+    }
+
+    const std::string& path_;
+    std::istream& in_;
+    std::streamoff size_;
+    ShardedBins& bins_;
+    JsonImport& report_;
+    std::string failure_;
+
+    int depth_ = 0;           // Open containers: 1 in the bin array, 2 in a bin
+    bool inRecord_ = false;
+    size_t index_ = 0;        // Position of the current record in the array
+    WasteBin bin_;
+    Field field_ = NONE;
+    unsigned seen_ = 0;
+    std::string error_;
+};
+
+// Helper: Stream bins from a JSON data file. Invalid records are skipped and
+// reported in report; a syntax error throws. Returns false if the file does
+// not exist.
+bool readJsonBins(const std::string& path, ShardedBins& bins, JsonImport& report) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    file.seekg(0, std::ios::end);
+    std::streamoff size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    BinImportHandler handler(path, file, size, bins, report);
+    if (!json::sax_parse(file, &handler)) {
+        throw std::runtime_error(handler.failure());
+    }
+    if (report.skipped > 0) {
+        std::cerr << "Skipped " << report.skipped << " invalid bins in " << path << std::endl;
+    }
+    return true;
+}
+
+// Helper: Milliseconds since start, for load timings
+long long elapsedMillis(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Helper: Load data from file. On failure the current bins are left untouched
+// and false is returned; an unreadable snapshot is never treated as "no bins".
+// The fill readings applied by the journal replay go to readings, if given.
+bool loadBinsFromFile(std::vector<ReplayedReading>* readings = nullptr) {
+    // Records still buffered by the journal writers must be on disk to replay
+    g_flusher.flushAll();
+
+    // Keep a compaction from moving files underneath the load
+    std::lock_guard<std::mutex> compactLock(g_compact_mutex);
+
+    ShardedBins bins(g_store.shardCount());
+    std::string source = SNAPSHOT_FILE;
+    try {
+        std::lock_guard<std::mutex> lock(g_file_mutex);
+
+        auto started = std::chrono::steady_clock::now();
+        if (MappedBinTable* table = g_store.mappedTable()) {
+            // The mapped table holds every change; there is no journal to replay
+            source = TABLE_FILE;
+            table->load([&bins](int id) -> BinTable& { return bins.forId(id); });
+            bins.reserveIds(table->nextId());
+        } else if (!loadBinarySnapshot(SNAPSHOT_FILE, bins)) {
+            // No binary snapshot yet: start from the JSON data file, if any
+            source = DATA_FILE;
+            JsonImport report;
+            if (!readJsonBins(DATA_FILE, bins, report)) {
+                source.clear();
+            }
+        }
+        if (!source.empty()) {
+            std::cout << "Loaded " << bins.size() << " bins from " << source
+                      << " in " << elapsedMillis(started) << " ms" << std::endl;
+        }
+
+        if (g_store.mappedTable() == nullptr) {
+            started = std::chrono::steady_clock::now();
+            size_t replayed = replayJournals(bins, findJournalFiles(g_store.shardCount()).replayOrder, readings);
+            if (replayed > 0) {
+                std::cout << "Replayed " << replayed << " journal records in " << elapsedMillis(started) << " ms" << std::endl;
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading data from " << source << ": " << e.what() << std::endl;
+        return false;
+    }
+
+    auto started = std::chrono::steady_clock::now();
+    g_store.replace(bins);
+    std::cout << "Published " << g_store.shardCount() << " shards in " << elapsedMillis(started) << " ms" << std::endl;
+    return true;
+}
+
+// Helper: Write a file and fsync it before returning
+bool writeFileDurably(const std::string& path, const std::string& content) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Error opening " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    const char* data = content.data();
+    size_t remaining = content.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, data, remaining);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            std::cerr << "Error writing " << path << ": " << std::strerror(errno) << std::endl;
+            ::close(fd);
+            return false;
+        }
+        data += written;
+        remaining -= static_cast<size_t>(written);
+    }
+
+    bool ok = ::fsync(fd) == 0;
+    if (!ok) {
+        std::cerr << "Error syncing " << path << ": " << std::strerror(errno) << std::endl;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// Helper: fsync the directory holding DATA_FILE so a rename is durable
+void syncDataDirectory() {
+    int fd = ::open(dataDirectory().c_str(), O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Helper: Replace a file atomically: write a synced temp file, rename it
+// over path and sync the directory
+bool replaceFileDurably(const std::string& path, const std::string& content) {
+    const std::string tmpFile = path + ".tmp";
+    if (!writeFileDurably(tmpFile, content)) {
+        return false;
+    }
+
+    if (std::rename(tmpFile.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error replacing " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    syncDataDirectory();
+    return true;
+}
+
+// Helper: Rotate one journal segment aside for compaction. If a previous
+// compaction did not finish, its rotated segment is kept and the live one is
+// appended to it so no record is lost; a missing or empty live segment
+// leaves it as it is.
+bool rotateJournalSegment(const std::string& path) {
+    const std::string compacting = path + ".compacting";
+
+    if (::access(compacting.c_str(), F_OK) == 0) {
+        std::ifstream live(path, std::ios::binary);
+        if (!live.is_open() || live.peek() == std::ifstream::traits_type::eof()) {
+            std::remove(path.c_str());
+            return true;
+        }
+
+        std::ofstream merged(compacting, std::ios::app | std::ios::binary);
+        std::vector<char> buffer(64 * 1024);
+        while (merged.is_open() && !live.bad() && !merged.bad()) {
+            live.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+            if (live.gcount() == 0) {
+                break;
+            }
+            merged.write(buffer.data(), live.gcount());
+        }
+        const bool opened = merged.is_open();
+        merged.close();
+        if (!opened || live.bad() || merged.bad() || merged.fail()) {
+            std::cerr << "Error merging journal into " << compacting << std::endl;
+            return false;
+        }
+        std::remove(path.c_str());
+    } else if (std::rename(path.c_str(), compacting.c_str()) != 0 && errno != ENOENT) {
+        std::cerr << "Error rotating journal " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Rollup file layout (version 2, little-endian): RollupFileHeader, then
+// recordCount RollupRecords (one per non-empty cell, plus one BIN_LAST per
+// bin), then districtCount district names as uint32 length + bytes. A
+// district record's owner is the index of its name. A BIN_LAST record holds
+// the bin's last counted reading (timestamp in sum, fill level in min), so
+// loadRollups can tell which journal readings are not in the file yet.
+// Version 1 files have no BIN_LAST records. The checksum covers everything
+// after the header.
+const std::string ROLLUP_FILE = "bin_data.rollups";
+const char ROLLUP_MAGIC[8] = {'S', 'M', 'W', 'S', 'R', 'O', 'L', 'L'};
+const uint32_t ROLLUP_VERSION = 2;
+
+struct RollupFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordSize;
+    uint64_t recordCount;
+    uint64_t districtCount;
+    uint64_t checksum;
+    uint64_t reserved[3];
+};
+
+struct RollupRecord {
+    enum Kind : uint8_t { BIN_HOUR, BIN_DAY, DISTRICT_HOUR, DISTRICT_DAY, BIN_LAST };
+
+    uint64_t sum;
+    int32_t period;
+    uint32_t count;
+    int32_t owner;  // Bin id, or district name index
+    uint8_t kind;
+    uint8_t min;
+    uint8_t max;
+    uint8_t reserved;
+};
+
+static_assert(sizeof(RollupFileHeader) == 64, "rollup file header layout changed");
+static_assert(sizeof(RollupRecord) == 24, "rollup record layout changed");
+
+// Helper: Save the rollups of every shard if they changed since the last
+// save. Runs from each compaction, the compactor's interval and shutdown.
+bool saveRollups() {
+    static std::mutex saveMutex;
+    static uint64_t savedChanges = 0;
+    std::lock_guard<std::mutex> lock(saveMutex);
+
+    uint64_t changes = 0;
+    for (size_t i = 0; i < g_store.shardCount(); i++) {
+        changes += g_store.rollups(i).changes();
+    }
+    if (changes == savedChanges) {
+        return true;
+    }
+
+    std::vector<RollupRecord> records;
+    std::map<std::string, uint32_t> districts;
+    auto record = [&records](RollupRecord::Kind kind, int32_t owner, const auto& cell) {
+        RollupRecord saved{};
+        saved.sum = cell.sum;
+        saved.period = cell.period;
+        saved.count = cell.count;
+        saved.owner = owner;
+        saved.kind = kind;
+        saved.min = cell.min;
+        saved.max = cell.max;
+        records.push_back(saved);
+    };
+    for (size_t i = 0; i < g_store.shardCount(); i++) {
+        g_store.rollups(i).forEachCell(
+            [&](int id, FillRollups::Resolution resolution, const FillRollups::BinCell& cell) {
+                record(resolution == FillRollups::HOUR ? RollupRecord::BIN_HOUR : RollupRecord::BIN_DAY, id, cell);
+            },
+            [&](const std::string& district, FillRollups::Resolution resolution, const FillRollups::DistrictCell& cell) {
+                const uint32_t index = districts.emplace(district, static_cast<uint32_t>(districts.size())).first->second;
+                record(resolution == FillRollups::HOUR ? RollupRecord::DISTRICT_HOUR : RollupRecord::DISTRICT_DAY,
+                       static_cast<int32_t>(index), cell);
+            });
+        g_store.rollups(i).forEachLastReading([&records](int id, int64_t timestamp, int fillLevel) {
+            RollupRecord saved{};
+            saved.sum = static_cast<uint64_t>(timestamp);
+            saved.owner = id;
+            saved.kind = RollupRecord::BIN_LAST;
+            saved.min = static_cast<uint8_t>(fillLevel);
+            records.push_back(saved);
+        });
+    }
+
+    std::vector<const std::string*> names(districts.size());
+    for (const auto& entry : districts) {
+        names[entry.second] = &entry.first;
+    }
+
+    RollupFileHeader header{};
+    std::memcpy(header.magic, ROLLUP_MAGIC, sizeof(header.magic));
+    header.version = ROLLUP_VERSION;
+    header.recordSize = sizeof(RollupRecord);
+    header.recordCount = records.size();
+    header.districtCount = names.size();
+
+    std::string out(sizeof(header), '\0');
+    out.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(RollupRecord));
+    for (const std::string* name : names) {
+        const uint32_t length = static_cast<uint32_t>(name->size());
+        out.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out += *name;
+    }
+    header.checksum = fnv1aChecksum(out.data() + sizeof(header), out.size() - sizeof(header));
+    std::memcpy(&out[0], &header, sizeof(header));
+
+    if (!replaceFileDurably(ROLLUP_FILE, out)) {
+        return false;
+    }
+    savedChanges = changes;
+    return true;
+}
+
+// Helper: Write a fresh snapshot and fold the journal into it.
+//
+// Every live journal segment is first renamed to <segment>.compacting, so
+// new mutations start fresh segments while the snapshot is taken. The
+// snapshot is written to a temp file, fsynced and renamed over SNAPSHOT_FILE,
+// and the rollups are saved; only then are the rotated segments (and any
+// stale journal files) removed, since the rollup replay at startup needs the
+// readings they hold until the rollups cover them.
+// A crash at any point leaves either the old snapshot or the new one intact,
+// plus journals that replay on top of it. Writers are only paused for the
+// renames, never for serialization or I/O, and readers are never blocked.
+bool compactBins() {
+    std::lock_guard<std::mutex> compactLock(g_compact_mutex);
+
+    // Stale files were replayed at load and nothing appends to them
+    std::vector<std::string> stale = findJournalFiles(g_store.shardCount()).stale;
+
+    // Rotate the segments with writers paused, so the snapshot returned by
+    // cut() holds exactly the changes recorded in the rotated segments
+    bool rotated = true;
+    BinSnapshot snapshot = g_store.cut([&rotated] {
+        std::lock_guard<std::mutex> lock(g_file_mutex);
+        for (JournalWriter* segment : g_store.journalSegments()) {
+            rotated = segment->withFileClosed([segment] {
+                return rotateJournalSegment(segment->path());
+            }) && rotated;
+        }
+    });
+
+    if (!rotated) {
+        return false;
+    }
+
+    try {
+        std::string encoded = encodeBinarySnapshot([&snapshot](auto&& fn) { snapshot.forEach(fn); }, g_store.nextId());
+        if (!replaceFileDurably(SNAPSHOT_FILE, encoded)) {
+            return false;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error writing snapshot: " << e.what() << std::endl;
+        return false;
+    }
+
+    // Keep the rotated segments until the rollups include their readings
+    if (!saveRollups()) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_file_mutex);
+    for (JournalWriter* segment : g_store.journalSegments()) {
+        std::remove((segment->path() + ".compacting").c_str());
+    }
+    for (const auto& path : stale) {
+        std::remove(path.c_str());
+    }
+    return true;
+}
+
+// Helper: Save data to file (full snapshot; the journal is folded into it)
+bool saveBinsToFile() {
+    return compactBins();
+}
+
+// Helper: Add journal readings the saved rollups have not counted. A bin's
+// readings up to the one matching its last counted reading are skipped;
+// readings in the same millisecond make the timestamp alone ambiguous.
+void addReplayedReadings(const std::vector<ReplayedReading>& readings) {
+    std::unordered_map<int, size_t> counted;  // Bin id -> readings before this index were counted
+    for (size_t i = 0; i < readings.size(); i++) {
+        const ReplayedReading& reading = readings[i];
+        int64_t timestamp;
+        int fillLevel;
+        if (g_store.rollups(g_store.shardForId(reading.id)).lastReading(reading.id, timestamp, fillLevel) &&
+            timestamp == reading.timestamp && fillLevel == reading.fillLevel) {
+            counted[reading.id] = i + 1;
+        }
+    }
+
+    BinSnapshot snapshot = g_store.acquire();
+    size_t added = 0;
+    for (size_t i = 0; i < readings.size(); i++) {
+        const ReplayedReading& reading = readings[i];
+        auto it = counted.find(reading.id);
+        if (it != counted.end() && i < it->second) {
+            continue;
+        }
+        // A bin deleted later in the journal has no rollups to add to
+        if (BinTable::Row bin = snapshot.find(reading.id)) {
+            g_store.rollups(g_store.shardForId(reading.id)).addReplayed(bin, reading.timestamp, reading.fillLevel);
+            added++;
+        }
+    }
+    if (added > 0) {
+        std::cout << "Added " << added << " replayed readings to the rollups" << std::endl;
+    }
+}
+
+// Helper: Load saved rollups into the shards (a missing file is fine), then
+// add the readings the journal replay applied since the rollups were saved.
+//
+// Readings compacted into the snapshot after the last rollup save are not
+// Compaction saves the rollups before it removes the rotated journal
+// segments, so every reading is in the saved rollups, the journal, or both.
+// The mapped table has no journal, so in mmap mode a crash loses every
+// reading since the last rollup save (every SMWS_ROLLUP_SAVE_INTERVAL_S and
+// at shutdown).
+bool loadRollups(const std::vector<ReplayedReading>& readings) {
+    std::ifstream file(ROLLUP_FILE, std::ios::binary);
+    if (!file.is_open()) {
+        addReplayedReadings(readings);
+        return true;
+    }
+    std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    try {
+        RollupFileHeader header;
+        if (data.size() < sizeof(header)) {
+            throw std::runtime_error("file is truncated");
+        }
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (std::memcmp(header.magic, ROLLUP_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version < 1 || header.version > ROLLUP_VERSION || header.recordSize != sizeof(RollupRecord)) {
+            throw std::runtime_error("unsupported format");
+        }
+        if (header.recordCount > (data.size() - sizeof(header)) / sizeof(RollupRecord)) {
+            throw std::runtime_error("file is truncated");
+        }
+        if (fnv1aChecksum(data.data() + sizeof(header), data.size() - sizeof(header)) != header.checksum) {
+            throw std::runtime_error("checksum mismatch");
+        }
+
+        size_t at = sizeof(header) + header.recordCount * sizeof(RollupRecord);
+        std::vector<std::string> names;
+        for (uint64_t i = 0; i < header.districtCount; i++) {
+            uint32_t length;
+            if (at + sizeof(length) > data.size()) {
+                throw std::runtime_error("file is truncated");
+            }
+            std::memcpy(&length, data.data() + at, sizeof(length));
+            at += sizeof(length);
+            if (length > data.size() - at) {
+                throw std::runtime_error("file is truncated");
+            }
+            names.emplace_back(data, at, length);
+            at += length;
+        }
+
+        for (uint64_t i = 0; i < header.recordCount; i++) {
+            RollupRecord saved;
+            std::memcpy(&saved, data.data() + sizeof(header) + i * sizeof(RollupRecord), sizeof(saved));
+            const FillRollups::Resolution resolution =
+                saved.kind == RollupRecord::BIN_HOUR || saved.kind == RollupRecord::DISTRICT_HOUR ? FillRollups::HOUR : FillRollups::DAY;
+            if (saved.kind == RollupRecord::BIN_HOUR || saved.kind == RollupRecord::BIN_DAY) {
+                FillRollups::BinCell cell;
+                cell.period = saved.period;
+                cell.count = saved.count;
+                cell.sum = static_cast<uint32_t>(saved.sum);
+                cell.min = saved.min;
+                cell.max = saved.max;
+                g_store.rollups(g_store.shardForId(saved.owner)).restoreBin(saved.owner, resolution, cell);
+            } else if (saved.kind == RollupRecord::BIN_LAST) {
+                g_store.rollups(g_store.shardForId(saved.owner))
+                    .restoreLastReading(saved.owner, static_cast<int64_t>(saved.sum), saved.min);
+            } else if (saved.kind <= RollupRecord::DISTRICT_DAY && static_cast<uint32_t>(saved.owner) < names.size()) {
+                FillRollups::DistrictCell cell;
+                cell.period = saved.period;
+                cell.count = saved.count;
+                cell.sum = saved.sum;
+                cell.min = saved.min;
+                cell.max = saved.max;
+                // District rollups are summed across shards when queried
+                g_store.rollups(0).restoreDistrict(names[saved.owner], resolution, cell);
+            } else {
+                throw std::runtime_error("invalid record");
+            }
+        }
+
+        std::cout << "Loaded " << header.recordCount << " rollup cells from " << ROLLUP_FILE << std::endl;
+
+        // A version 1 file cannot tell counted readings from new ones
+        if (header.version >= 2) {
+            addReplayedReadings(readings);
+        }
+        return true;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error loading " << ROLLUP_FILE << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// Helper: Export the current bins to the JSON data file
+bool exportBinsToJson() {
+    std::lock_guard<std::mutex> compactLock(g_compact_mutex);
+
+    BinSnapshot snapshot = g_store.acquire();
+    try {
+        json data = json::array();
+        snapshot.forEach([&data](const BinTable::Row& bin) {
+            data.push_back(bin.toBin().toJson());
+        });
+        return replaceFileDurably(DATA_FILE, data.dump(4));
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error exporting " << DATA_FILE << ": " << e.what() << std::endl;
+        return false;
+    }
+}
+
+// Helper: Replace all bins with the contents of the JSON data file.
+//
+// The imported bins are written as the new binary snapshot and swapped in
+// with writers paused; the journal segments, which describe the replaced
+// bins, are rotated aside before the snapshot rename and removed after it.
+// A crash before the rename keeps the old bins and their journal. On
+// failure the current bins are left untouched and false is returned.
+bool importBinsFromJson(JsonImport& report) {
+    ShardedBins bins(g_store.shardCount());
+    try {
+        std::lock_guard<std::mutex> lock(g_file_mutex);
+        if (!readJsonBins(DATA_FILE, bins, report)) {
+            report.failure = "file not found";
+        }
+    }
+    catch (const std::exception& e) {
+        report.failure = e.what();
+    }
+    if (!report.failure.empty()) {
+        std::cerr << "Error importing " << DATA_FILE << ": " << report.failure << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> compactLock(g_compact_mutex);
+    std::vector<std::string> stale = findJournalFiles(g_store.shardCount()).stale;
+    const std::string tmpFile = SNAPSHOT_FILE + ".tmp";
+    if (!writeFileDurably(tmpFile, encodeBinarySnapshot([&bins](auto&& fn) { bins.forEach(fn); }, bins.reservedIds()))) {
+        return false;
+    }
+
+    // The new mapped table is built and synced under a temporary name, as
+    // at startup, and only renamed over the live one when it is complete
+    MappedBinTable fresh;
+    if (g_store.mappedTable() != nullptr) {
+        const std::string newTable = TABLE_FILE + ".new";
+        std::remove((newTable + ".locations").c_str());
+        std::remove(newTable.c_str());
+        try {
+            fresh.open(newTable);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Error importing " << DATA_FILE << ": " << e.what() << std::endl;
+            return false;
+        }
+        if (!fresh.reset([&bins](auto&& fn) { bins.forEach(fn); }, bins.reservedIds())) {
+            std::cerr << "Error importing " << DATA_FILE << ": could not write " << newTable << std::endl;
+            return false;
+        }
+    }
+
+    const bool replaced = g_store.replace(bins, [&stale, &tmpFile, &fresh] {
+        std::lock_guard<std::mutex> lock(g_file_mutex);
+        for (JournalWriter* segment : g_store.journalSegments()) {
+            if (!segment->withFileClosed([segment] { return rotateJournalSegment(segment->path()); })) {
+                return false;
+            }
+        }
+
+        if (std::rename(tmpFile.c_str(), SNAPSHOT_FILE.c_str()) != 0) {
+            std::cerr << "Error replacing " << SNAPSHOT_FILE << ": " << std::strerror(errno) << std::endl;
+            return false;
+        }
+        syncDataDirectory();
+
+        for (JournalWriter* segment : g_store.journalSegments()) {
+            std::remove((segment->path() + ".compacting").c_str());
+        }
+        for (const auto& path : stale) {
+            std::remove(path.c_str());
+        }
+
+        if (MappedBinTable* table = g_store.mappedTable()) {
+            if (!table->replaceWith(fresh)) {
+                return false;
+            }
+            syncDataDirectory();
+        }
+        return true;
+    });
+
+    // The saved rollups describe the replaced bins
+    if (replaced) {
+        saveRollups();
+    }
+    return replaced;
+}
+
+// Background compactor: periodically folds the journal into a new snapshot
+// so journal size and startup replay time stay bounded, and saves the
+// rollups every rollupInterval (checked on the same ticks)
+class SnapshotCompactor {
+public:
+    SnapshotCompactor(std::chrono::seconds interval, std::chrono::seconds rollupInterval)
+        : interval_(interval), rollupInterval_(rollupInterval) {}
+
+    ~SnapshotCompactor() {
+        stop();
+    }
+
+    void start() {
+        worker_ = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+private:
+    void run() {
+        auto rollupsSaved = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!cv_.wait_for(lock, interval_, [this] { return stopping_; })) {
+            lock.unlock();
+            if (journalHasRecords()) {
+                compactBins();
+            }
+            if (std::chrono::steady_clock::now() - rollupsSaved >= rollupInterval_) {
+                saveRollups();
+                rollupsSaved = std::chrono::steady_clock::now();
+            }
+            lock.lock();
+        }
+    }
+
+    static bool journalHasRecords() {
+        for (JournalWriter* segment : g_store.journalSegments()) {
+            std::ifstream file(segment->path(), std::ios::binary | std::ios::ate);
+            if (segment->hasPending() || (file.is_open() && file.tellg() > 0)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::chrono::seconds interval_;
+    std::chrono::seconds rollupInterval_;
+    std::thread worker_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_ = false;
+};
+
+// Binary sensor ingest protocol, served on SMWS_INGEST_PORT for gateways
+// where HTTP+JSON costs more than the readings themselves. A connection
+// carries frames of packed readings, all integers little-endian:
+//   frame: IngestFrameHeader, then header.count IngestRecord entries
+//   ack:   IngestAck, written once the frame has been applied; if a frame
+//          cannot be synced the connection is closed without an ack
+// Frames on one connection are applied in order, one at a time, through the
+// same batched path as POST /bins/readings.
+const uint32_t INGEST_FLAG_DURABLE = 1;  // Ack only once the frame is on disk
+
+struct IngestFrameHeader {
+    uint32_t count;  // Readings that follow, at most MAX_READINGS_PER_REQUEST
+    uint32_t flags;
+};
+
+struct IngestRecord {
+    int64_t sensorTimestamp;  // Epoch milliseconds; 0 means the arrival time
+    int32_t binId;
+    int32_t fillLevel;        // Clamped to 0..100
+};
+
+struct IngestAck {
+    uint32_t applied;
+    uint32_t notFound;
+    uint32_t stale;
+    uint32_t invalid;
+};
+
+static_assert(sizeof(IngestFrameHeader) == 8, "unexpected ingest frame header layout");
+static_assert(sizeof(IngestRecord) == 16, "unexpected ingest record layout");
+static_assert(sizeof(IngestAck) == 16, "unexpected ingest ack layout");
+
+// Helper: Read exactly size bytes; false on EOF or error
+bool readFully(int fd, void* data, size_t size) {
+    char* at = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = ::recv(fd, at, size, 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        at += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Helper: Write exactly size bytes; false if the peer went away
+bool writeFully(int fd, const void* data, size_t size) {
+    const char* at = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = ::send(fd, at, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        at += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// TCP listener for the binary ingest protocol, one thread per connection.
+// Backpressure: a connection reads its next frame only after the previous
+// one is acknowledged, so a fast sender fills its socket buffers and blocks;
+// across connections at most maxInFlight readings are being applied at once
+// (a frame waits for budget before it is applied), and connections beyond
+// maxConnections are closed on accept.
+class IngestListener {
+public:
+    struct Counters {
+        uint64_t frames = 0;
+        uint64_t readings = 0;
+        uint64_t applied = 0;
+        uint64_t notFound = 0;
+        uint64_t stale = 0;
+        uint64_t invalid = 0;
+        uint64_t bytes = 0;
+        uint64_t throttled = 0;  // Frames that waited for in-flight budget
+
+        Counters& operator+=(const Counters& other) {
+            frames += other.frames;
+            readings += other.readings;
+            applied += other.applied;
+            notFound += other.notFound;
+            stale += other.stale;
+            invalid += other.invalid;
+            bytes += other.bytes;
+            throttled += other.throttled;
+            return *this;
+        }
+
+        json toJson() const {
+            return {
+                {"frames", frames},
+                {"readings", readings},
+                {"applied", applied},
+                {"notFound", notFound},
+                {"stale", stale},
+                {"invalid", invalid},
+                {"bytes", bytes},
+                {"throttledFrames", throttled}
+            };
+        }
+    };
+
+    IngestListener(size_t maxConnections, size_t maxInFlight)
+        : maxConnections_(std::max<size_t>(1, maxConnections)),
+          maxInFlight_(std::max<size_t>(1, maxInFlight)) {}
+
+    ~IngestListener() {
+        stop();
+    }
+
+    // Bind and start accepting; throws if the address cannot be bound
+    void start(const std::string& host, int port) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+            throw std::runtime_error("Invalid ingest address " + host);
+        }
+
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            throw std::runtime_error(std::string("Cannot create ingest socket: ") + std::strerror(errno));
+        }
+        int reuse = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || ::listen(fd, 64) != 0) {
+            std::string reason = std::strerror(errno);
+            ::close(fd);
+            throw std::runtime_error("Cannot listen for ingest on " + host + ":" + std::to_string(port) + ": " + reason);
+        }
+
+        listenFd_ = fd;
+        address_ = host + ":" + std::to_string(port);
+        acceptor_ = std::thread([this] { acceptLoop(); });
+    }
+
+    // Stop accepting, disconnect every gateway and wait for their threads
+    void stop() {
+        if (!acceptor_.joinable()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+            for (const auto& entry : connections_) {
+                ::shutdown(entry.second.fd, SHUT_RDWR);
+            }
+        }
+        ::shutdown(listenFd_, SHUT_RDWR);
+        acceptor_.join();
+        ::close(listenFd_);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this] { return connections_.empty(); });
+    }
+
+    bool running() const {
+        return listenFd_ >= 0;
+    }
+
+    // Listener status with per-connection counters, for GET /admin/ingest
+    json status() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Counters totals = closedTotals_;
+        json connections = json::array();
+        for (const auto& entry : connections_) {
+            const Connection& connection = entry.second;
+            json item = connection.counters.toJson();
+            item["id"] = entry.first;
+            item["peer"] = connection.peer;
+            item["connectedAt"] = formatTimestamp(connection.connectedAt);
+            connections.push_back(item);
+            totals += connection.counters;
+        }
+
+        return {
+            {"address", address_},
+            {"maxConnections", maxConnections_},
+            {"maxInFlightReadings", maxInFlight_},
+            {"inFlightReadings", inFlight_},
+            {"connections", connections},
+            {"closedConnections", closedConnections_},
+            {"rejectedConnections", rejectedConnections_},
+            {"totals", totals.toJson()}
+        };
+    }
+
+private:
+    struct Connection {
+        int fd;
+        std::string peer;
+        int64_t connectedAt;
+        Counters counters;
+    };
+
+    void acceptLoop() {
+        while (true) {
+            sockaddr_in peer{};
+            socklen_t peerLength = sizeof(peer);
+            int fd = ::accept4(listenFd_, reinterpret_cast<sockaddr*>(&peer), &peerLength, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!stopping_) {
+                    std::cerr << "Ingest listener stopped accepting: " << std::strerror(errno) << std::endl;
+                }
+                return;
+            }
+
+            char host[INET_ADDRSTRLEN] = "?";
+            ::inet_ntop(AF_INET, &peer.sin_addr, host, sizeof(host));
+            int noDelay = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_ || connections_.size() >= maxConnections_) {
+                rejectedConnections_++;
+                ::close(fd);
+                continue;
+            }
+            uint64_t id = nextId_++;
+            connections_[id] = Connection{fd, std::string(host) + ":" + std::to_string(ntohs(peer.sin_port)), currentTimeMillis(), {}};
+            std::thread([this, id, fd] { serve(id, fd); }).detach();
+        }
+    }
+
+    void serve(uint64_t id, int fd) {
+        // Decode buffers grow to the largest frame seen and are then reused,
+        // so steady-state frames decode without allocating
+        std::vector<IngestRecord> records;
+        std::vector<SensorReading> readings;
+        IngestFrameHeader header;
+
+        while (readFully(fd, &header, sizeof(header))) {
+            if (header.count > MAX_READINGS_PER_REQUEST) {
+                std::cerr << "Closing ingest connection " << id << ": frame of " << header.count
+                          << " readings exceeds " << MAX_READINGS_PER_REQUEST << std::endl;
+                break;
+            }
+            if (records.size() < header.count) {
+                records.resize(header.count);
+                readings.reserve(header.count);
+            }
+            if (!readFully(fd, records.data(), header.count * sizeof(IngestRecord))) {
+                break;
+            }
+
+            if (g_flusher.failed()) {
+                std::cerr << "Closing ingest connection " << id << ": writes are disabled after a failed sync" << std::endl;
+                break;
+            }
+
+            const bool throttled = acquire(header.count);
+            const int64_t now = currentTimeMillis();
+            readings.clear();
+            for (uint32_t i = 0; i < header.count; i++) {
+                const IngestRecord& record = records[i];
+                // Same checks as SensorReading::parse, so both paths agree
+                SensorReading& reading = readings.emplace_back();
+                reading.timestamp = record.sensorTimestamp == 0 ? now : record.sensorTimestamp;
+                reading.setFillLevel(record.fillLevel);
+                if (reading.setBinId(record.binId) && reading.checkTimestamp(now)) {
+                    reading.status = SensorReading::UPDATED;
+                }
+            }
+
+            CommitTicket ticket;
+            applySensorReadings(readings, ticket);
+            release(header.count);
+            if (!commitMutation(ticket, (header.flags & INGEST_FLAG_DURABLE) != 0)) {
+                // No ack: the client must not treat the frame as durable
+                std::cerr << "Closing ingest connection " << id << ": frame could not be synced" << std::endl;
+                break;
+            }
+
+            IngestAck ack{};
+            for (const auto& reading : readings) {
+                switch (reading.status) {
+                    case SensorReading::UPDATED: ack.applied++; break;
+                    case SensorReading::NOT_FOUND: ack.notFound++; break;
+                    case SensorReading::STALE: ack.stale++; break;
+                    case SensorReading::INVALID: ack.invalid++; break;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                Counters& counters = connections_[id].counters;
+                counters.frames++;
+                counters.readings += header.count;
+                counters.applied += ack.applied;
+                counters.notFound += ack.notFound;
+                counters.stale += ack.stale;
+                counters.invalid += ack.invalid;
+                counters.bytes += sizeof(header) + header.count * sizeof(IngestRecord);
+                counters.throttled += throttled;
+            }
+
+            if (!writeFully(fd, &ack, sizeof(ack))) {
+                break;
+            }
+        }
+
+        // Closed under the lock so stop() never shuts down a reused descriptor
+        std::lock_guard<std::mutex> lock(mutex_);
+        ::close(fd);
+        closedTotals_ += connections_[id].counters;
+        closedConnections_++;
+        connections_.erase(id);
+        changed_.notify_all();
+    }
+
+    // Reserve in-flight budget for a frame; returns true if it had to wait.
+    // A frame larger than the whole budget runs once nothing else is in flight.
+    bool acquire(size_t readings) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto fits = [&] { return inFlight_ == 0 || inFlight_ + readings <= maxInFlight_; };
+        const bool waited = !fits();
+        changed_.wait(lock, fits);
+        inFlight_ += readings;
+        return waited;
+    }
+
+    void release(size_t readings) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        inFlight_ -= readings;
+        changed_.notify_all();
+    }
+
+    const size_t maxConnections_;
+    const size_t maxInFlight_;
+    int listenFd_ = -1;
+    std::string address_;
+    std::thread acceptor_;
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::map<uint64_t, Connection> connections_;
+    uint64_t nextId_ = 1;
+    size_t inFlight_ = 0;
+    bool stopping_ = false;
+    Counters closedTotals_;
+    uint64_t closedConnections_ = 0;
+    uint64_t rejectedConnections_ = 0;
+};
+
+// Option handlers of an in-binary tool by name; a handler throws on a bad value
+using ToolOptions = std::map<std::string, std::function<void(const std::string& value)>>;
+
+// Helper: Apply a tool's --name=value arguments through its handlers. An
+// unknown option or a value its handler rejects is reported; returns false.
+bool parseToolOptions(int argc, char* argv[], const char* tool, const ToolOptions& handlers) {
+    for (int i = 0; i < argc; i++) {
+        const std::string arg = argv[i];
+        const size_t eq = arg.find('=');
+        auto handler = handlers.find(arg.substr(0, eq));
+        try {
+            if (handler == handlers.end()) {
+                throw std::invalid_argument("unknown option");
+            }
+            handler->second(eq == std::string::npos ? "" : arg.substr(eq + 1));
+        }
+        catch (const std::exception&) {
+            std::cerr << "Invalid " << tool << " option " << arg << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Helper: Handler that parses an integer option into target
+std::function<void(const std::string&)> intOption(int& target) {
+    return [&target](const std::string& value) { target = std::stoi(value); };
+}
+
+// Helper: Random generator for worker index of a load tool; repeatable per
+// worker and different between workers
+std::mt19937 workerRng(int index) {
+    return std::mt19937(static_cast<uint32_t>(index) * 7919u + 1u);
+}
+
+// Helper: Run fn(index) for index 0..count-1 on its own thread each; returns
+// the wall time in seconds once all of them have finished
+double runWorkers(int count, const std::function<void(int index)>& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (int i = 0; i < count; i++) {
+        workers.emplace_back(fn, i);
+    }
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Helper: Create a temp directory and make it the working directory, so a
+// tool's data files land there; returns its path, or "" (reported) on error
+std::string enterTempDirectory(const std::string& prefix) {
+    std::string dir = getEnvString("TMPDIR", "/tmp") + "/" + prefix + "-XXXXXX";
+    if (::mkdtemp(&dir[0]) == nullptr || ::chdir(dir.c_str()) != 0) {
+        std::cerr << "Cannot create a temp directory: " << std::strerror(errno) << std::endl;
+        return "";
+    }
+    return dir;
+}
+
+// Helper: Remove the files of the temp directory entered by
+// enterTempDirectory, then the directory itself
+void removeTempDirectory(const std::string& dir) {
+    if (DIR* handle = ::opendir(".")) {
+        while (dirent* entry = ::readdir(handle)) {
+            if (std::strcmp(entry->d_name, ".") != 0 && std::strcmp(entry->d_name, "..") != 0) {
+                ::unlink(entry->d_name);
+            }
+        }
+        ::closedir(handle);
+    }
+    ::rmdir(dir.c_str());
+}
+
+// Local load generator for the binary ingest listener:
+//   smart_waste_server ingest-load [--host=127.0.0.1] [--port=9090]
+//       [--connections=4] [--frames=100] [--batch=1000] [--bins=1000]
+//       [--window=4] [--durable]
+// Each connection sends frames of random readings for bin ids 1..bins,
+// keeping up to window frames unacknowledged, and the totals are reported.
+int runIngestLoad(int argc, char* argv[]) {
+    std::string host = "127.0.0.1";
+    int port = 9090;
+    int connections = 4;
+    int frames = 100;
+    int batch = 1000;
+    int bins = 1000;
+    int window = 4;
+    bool durable = false;
+
+    if (!parseToolOptions(argc, argv, "ingest-load", {
+        {"--host", [&host](const std::string& value) { host = value; }},
+        {"--port", intOption(port)},
+        {"--connections", intOption(connections)},
+        {"--frames", intOption(frames)},
+        {"--batch", intOption(batch)},
+        {"--bins", intOption(bins)},
+        {"--window", intOption(window)},
+        {"--durable", [&durable](const std::string&) { durable = true; }},
+    })) {
+        return 2;
+    }
+    if (connections < 1 || frames < 0 || batch < 1 || static_cast<size_t>(batch) > MAX_READINGS_PER_REQUEST ||
+        bins < 1 || window < 1) {
+        std::cerr << "ingest-load needs connections, batch, bins and window of at least 1 and batch of at most "
+                  << MAX_READINGS_PER_REQUEST << std::endl;
+        return 2;
+    }
+
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (::inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+        std::cerr << "Invalid ingest address " << host << std::endl;
+        return 2;
+    }
+
+    std::mutex totalsMutex;
+    IngestAck totals{};
+    int failed = 0;
+
+    auto worker = [&](int index) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            std::lock_guard<std::mutex> lock(totalsMutex);
+            std::cerr << "Connection " << index << " failed: " << std::strerror(errno) << std::endl;
+            failed++;
+            if (fd >= 0) ::close(fd);
+            return;
+        }
+        int noDelay = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        std::mt19937 rng = workerRng(index);
+        std::uniform_int_distribution<int> binDist(1, bins);
+        std::uniform_int_distribution<int> fillDist(0, 100);
+        std::vector<char> frame(sizeof(IngestFrameHeader) + static_cast<size_t>(batch) * sizeof(IngestRecord));
+        IngestAck sums{};
+        bool ok = true;
+
+        auto sendFrame = [&] {
+            IngestFrameHeader header{static_cast<uint32_t>(batch), durable ? INGEST_FLAG_DURABLE : 0u};
+            std::memcpy(frame.data(), &header, sizeof(header));
+            const int64_t now = currentTimeMillis();
+            for (int i = 0; i < batch; i++) {
+                IngestRecord record{now, binDist(rng), fillDist(rng)};
+                std::memcpy(frame.data() + sizeof(header) + i * sizeof(IngestRecord), &record, sizeof(record));
+            }
+            return writeFully(fd, frame.data(), frame.size());
+        };
+        auto readAck = [&] {
+            IngestAck ack;
+            if (!readFully(fd, &ack, sizeof(ack))) {
+                return false;
+            }
+            sums.applied += ack.applied;
+            sums.notFound += ack.notFound;
+            sums.stale += ack.stale;
+            sums.invalid += ack.invalid;
+            return true;
+        };
+
+        int sent = 0;
+        int acked = 0;
+        while (ok && acked < frames) {
+            if (sent < frames && sent - acked < window) {
+                ok = sendFrame();
+                sent++;
+            } else if ((ok = readAck())) {
+                acked++;
+            }
+        }
+        ::close(fd);
+
+        std::lock_guard<std::mutex> lock(totalsMutex);
+        if (!ok) {
+            std::cerr << "Connection " << index << " dropped after " << acked << " acknowledged frames" << std::endl;
+            failed++;
+        }
+        totals.applied += sums.applied;
+        totals.notFound += sums.notFound;
+        totals.stale += sums.stale;
+        totals.invalid += sums.invalid;
+    };
+
+    const double seconds = runWorkers(connections, worker);
+
+    const uint64_t readings = static_cast<uint64_t>(totals.applied) + totals.notFound + totals.stale + totals.invalid;
+    std::cout << "Sent " << readings << " readings over " << connections << " connections in "
+              << std::fixed << std::setprecision(3) << seconds << " s ("
+              << std::setprecision(0) << (seconds > 0 ? readings / seconds : 0.0) << " readings/s): "
+              << totals.applied << " applied, " << totals.notFound << " not found, " << totals.stale << " stale, "
+              << totals.invalid << " invalid" << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+// Compression benchmark for history blocks on synthetic fill curves:
+//   smart_waste_server history-bench [--bins=1000] [--days=30]
+//       [--interval=300] [--jitter=0]
+// Each bin fills at its own rate with sensor noise and is emptied when it
+// nears full; readings arrive every interval seconds, up to jitter
+// milliseconds late. Reports the encoded size against raw 16-byte samples
+// and the streaming decode rate, after checking every sample round-trips.
+int runHistoryBench(int argc, char* argv[]) {
+    int bins = 1000;
+    int days = 30;
+    int interval = 300;
+    int jitter = 0;
+
+    if (!parseToolOptions(argc, argv, "history-bench", {
+        {"--bins", intOption(bins)},
+        {"--days", intOption(days)},
+        {"--interval", intOption(interval)},
+        {"--jitter", intOption(jitter)},
+    })) {
+        return 2;
+    }
+    if (bins < 1 || days < 1 || interval < 1 || jitter < 0) {
+        std::cerr << "history-bench needs bins, days and interval of at least 1" << std::endl;
+        return 2;
+    }
+
+    const size_t samplesPerBin = static_cast<size_t>(days) * 86400 / static_cast<size_t>(interval);
+    std::mt19937 rng(42);
+    std::vector<std::vector<FillSample>> curves(static_cast<size_t>(bins));
+    for (auto& curve : curves) {
+        std::uniform_real_distribution<double> rateDist(0.05, 1.5);  // Percent per reading
+        std::uniform_int_distribution<int> noiseDist(-1, 1);
+        std::uniform_int_distribution<int> jitterDist(0, jitter);
+        const double rate = rateDist(rng);
+        double level = std::uniform_real_distribution<double>(0, 50)(rng);
+        int64_t scheduled = 1767225600000;  // 2026-01-01T00:00:00Z
+        curve.reserve(samplesPerBin);
+        for (size_t i = 0; i < samplesPerBin; i++) {
+            level += rate;
+            if (level >= 95) {
+                level = std::uniform_real_distribution<double>(0, 5)(rng);  // Collected
+            }
+            const int fill = std::max(0, std::min(100, static_cast<int>(level) + noiseDist(rng)));
+            curve.push_back(FillSample{scheduled + jitterDist(rng), fill});
+            scheduled += static_cast<int64_t>(interval) * 1000;
+        }
+    }
+
+    // Encode into sealed-size blocks
+    struct Block {
+        std::vector<uint8_t> bytes;
+        size_t count;
+    };
+    std::vector<Block> blocks;
+    size_t encodedBytes = 0;
+    auto start = std::chrono::steady_clock::now();
+    HistoryBlockEncoder encoder;
+    for (const auto& curve : curves) {
+        for (size_t i = 0; i < curve.size(); i++) {
+            encoder.append(curve[i].timestamp, curve[i].fillLevel);
+            if (encoder.count() == HISTORY_BLOCK_SAMPLES || i + 1 == curve.size()) {
+                blocks.push_back(Block{encoder.bytes(), encoder.count()});
+                encodedBytes += sizeof(HistoryBlockHeader) + encoder.bytes().size();
+                encoder.reset();
+            }
+        }
+    }
+    const double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // Decode and verify
+    start = std::chrono::steady_clock::now();
+    size_t decoded = 0;
+    size_t mismatches = 0;
+    size_t curve = 0;
+    size_t position = 0;
+    for (const auto& block : blocks) {
+        HistoryBlockDecoder decoder(block.bytes.data(), block.bytes.size(), block.count);
+        FillSample sample;
+        while (decoder.next(sample)) {
+            const FillSample& expected = curves[curve][position];
+            mismatches += sample.timestamp != expected.timestamp || sample.fillLevel != expected.fillLevel;
+            decoded++;
+            if (++position == curves[curve].size()) {
+                curve++;
+                position = 0;
+            }
+        }
+    }
+    const double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    const size_t samples = samplesPerBin * static_cast<size_t>(bins);
+    const size_t rawBytes = samples * 16;
+    std::cout << std::fixed << std::setprecision(2)
+              << samples << " samples (" << bins << " bins x " << samplesPerBin << "), " << blocks.size() << " blocks\n"
+              << "raw " << rawBytes << " bytes, encoded " << encodedBytes << " bytes including block headers: "
+              << static_cast<double>(encodedBytes) / samples << " bytes/sample, ratio "
+              << static_cast<double>(rawBytes) / encodedBytes << "x\n"
+              << "encode " << samples / encodeSeconds / 1e6 << " M samples/s, decode "
+              << decoded / decodeSeconds / 1e6 << " M samples/s" << std::endl;
+    if (decoded != samples || mismatches != 0) {
+        std::cerr << "Round trip failed: decoded " << decoded << " of " << samples << " samples, "
+                  << mismatches << " mismatches" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Scan kernel benchmark:
+//   smart_waste_server scan-bench [--bins=10000,100000,1000000,10000000]
+// For each size, fills a column with random fill levels and times the sum,
+// the fill histogram (the three bucket thresholds), countAtLeast and
+// selectFillRange under every kernel set this CPU can run. Then puts the
+// same bins in a std::vector<WasteBin>, as the store kept them before the
+// columnar layout, and in a BinTable, and times the dashboard histogram and
+// the needsCollection filter over each. Fails if a kernel set disagrees with
+// the scalar kernels or the two layouts disagree.
+int runScanBench(int argc, char* argv[]) {
+    std::vector<size_t> sizes = {10000, 100000, 1000000, 10000000};
+
+    auto parseSizes = [&sizes](const std::string& value) {
+        sizes.clear();
+        for (size_t begin = 0; begin <= value.size();) {
+            size_t end = std::min(value.find(',', begin), value.size());
+            const int bins = std::stoi(value.substr(begin, end - begin));
+            if (bins < 1) {
+                throw std::invalid_argument("bins");
+            }
+            sizes.push_back(static_cast<size_t>(bins));
+            begin = end + 1;
+        }
+    };
+    if (!parseToolOptions(argc, argv, "scan-bench", {{"--bins", parseSizes}})) {
+        return 2;
+    }
+
+    const std::vector<ScanKernels> kernels = availableScanKernels();
+    const ScanKernels& reference = kernels.back();  // Scalar
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int> fillDist(0, 100);
+    volatile uint64_t sink = 0;  // Keeps the timed results alive
+    bool mismatch = false;
+
+    std::cout << std::fixed << std::setprecision(0);
+    for (size_t bins : sizes) {
+        std::vector<uint8_t> fill(bins);
+        for (auto& level : fill) {
+            level = static_cast<uint8_t>(fillDist(rng));
+        }
+        std::vector<uint64_t> mask((bins + 63) / 64);
+        std::vector<uint64_t> expectedMask(mask.size());
+        reference.selectFillRange(fill.data(), bins, 40, 80, expectedMask.data());
+
+        // Around 2e8 bins per measurement, so small sizes are not all timer noise
+        const size_t rounds = std::max<size_t>(3, 200000000 / bins);
+        auto rate = [&](const std::function<uint64_t()>& scan) {
+            const auto start = std::chrono::steady_clock::now();
+            for (size_t round = 0; round < rounds; round++) {
+                sink = sink + scan();
+            }
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            return static_cast<double>(bins) * rounds / seconds / 1e6;
+        };
+        auto histogram = [&](const ScanKernels& k) {
+            return std::array<size_t, 3>{k.countAtLeast(fill.data(), bins, FILL_MEDIUM_MIN),
+                                         k.countAtLeast(fill.data(), bins, FILL_HIGH_MIN),
+                                         k.countAtLeast(fill.data(), bins, FILL_CRITICAL_MIN)};
+        };
+
+        std::cout << bins << " bins, " << rounds << " rounds (M bins/s)\n"
+                  << std::setw(10) << "kernels" << std::setw(10) << "sum" << std::setw(12) << "histogram"
+                  << std::setw(14) << "countAtLeast" << std::setw(17) << "selectFillRange" << std::endl;
+        for (const auto& k : kernels) {
+            k.selectFillRange(fill.data(), bins, 40, 80, mask.data());
+            mismatch = mismatch || mask != expectedMask || histogram(k) != histogram(reference) ||
+                       k.sumFill(fill.data(), bins) != reference.sumFill(fill.data(), bins);
+
+            std::cout << std::setw(10) << k.name
+                      << std::setw(10) << rate([&] { return k.sumFill(fill.data(), bins); })
+                      << std::setw(12) << rate([&] { return histogram(k)[0]; })
+                      << std::setw(14) << rate([&] { return k.countAtLeast(fill.data(), bins, COLLECTION_THRESHOLD); })
+                      << std::setw(17) << rate([&] {
+                             k.selectFillRange(fill.data(), bins, 40, 80, mask.data());
+                             return mask[0];
+                         }) << std::endl;
+        }
+
+        std::vector<WasteBin> rows;
+        BinTable table;
+        rows.reserve(bins);
+        table.reserve(bins);
+        for (size_t i = 0; i < bins; i++) {
+            rows.emplace_back(static_cast<int>(i + 1), "Street " + std::to_string(i % 1000), fill[i],
+                              fill[i] >= COLLECTION_THRESHOLD);
+            table.insert(rows.back());
+        }
+
+        // Row by row, as /dashboard/stats and /optimize-route scanned the vector
+        auto rowHistogram = [&] {
+            ShardAggregates result;
+            result.bins = rows.size();
+            for (const auto& bin : rows) {
+                result.fillSum += bin.fillLevel;
+                result.needsCollection += bin.needsCollection;
+                result.fillBuckets[ShardAggregates::bucketFor(bin.fillLevel)]++;
+            }
+            return result;
+        };
+        std::vector<int> ids;
+        ids.reserve(bins);
+        auto rowFilter = [&] {
+            ids.clear();
+            for (const auto& bin : rows) {
+                if (bin.needsCollection) {
+                    ids.push_back(bin.id);
+                }
+            }
+            return static_cast<uint64_t>(ids.size());
+        };
+        auto columnFilter = [&] {
+            ids.clear();
+            forEachFillMatch(table, 0, 100, 1, [&ids](const BinTable::Row& bin) { ids.push_back(bin.id()); });
+            return static_cast<uint64_t>(ids.size());
+        };
+
+        rowFilter();
+        const std::vector<int> rowIds = ids;
+        columnFilter();
+        mismatch = mismatch || !(rowHistogram() == aggregateTable(table)) || ids != rowIds;
+
+        std::cout << std::setw(20) << "layout" << std::setw(12) << "histogram" << std::setw(17) << "needsCollection"
+                  << std::endl
+                  << std::setw(20) << "vector<WasteBin>"
+                  << std::setw(12) << rate([&] { return static_cast<uint64_t>(rowHistogram().fillSum); })
+                  << std::setw(17) << rate(rowFilter) << std::endl
+                  << std::setw(20) << "BinTable columns"
+                  << std::setw(12) << rate([&] { return static_cast<uint64_t>(aggregateTable(table).fillSum); })
+                  << std::setw(17) << rate(columnFilter) << std::endl;
+    }
+
+    if (mismatch) {
+        std::cerr << "Scan kernels or bin layouts disagree" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Helper: Run fn in a forked child, so it starts from untouched globals
+// (store, pools, location arena), and return the string it produced; empty
+// if the child failed. Call only while the process is single-threaded.
+std::string runInChild(const std::function<std::string()>& fn) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+        return "";
+    }
+    std::cout.flush();
+    const pid_t pid = ::fork();
+    if (pid < 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return "";
+    }
+    if (pid == 0) {
+        ::close(fds[0]);
+        int status = 0;
+        try {
+            const std::string result = fn();
+            status = ::write(fds[1], result.data(), result.size()) == static_cast<ssize_t>(result.size()) ? 0 : 1;
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+        std::cout.flush();
+        ::_exit(status);
+    }
+
+    ::close(fds[1]);
+    std::string result;
+    char buffer[4096];
+    ssize_t n;
+    while ((n = ::read(fds[0], buffer, sizeof(buffer))) > 0 || (n < 0 && errno == EINTR)) {
+        if (n > 0) {
+            result.append(buffer, static_cast<size_t>(n));
+        }
+    }
+    ::close(fds[0]);
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? result : "";
+}
+
+// Startup load benchmark:
+//   smart_waste_server load-bench [--bins=1000000] [--journal=100000] [--shards=<cores>]
+// Writes a synthetic binary snapshot of bins and journal segments holding
+// journal records (mostly updates, some adds and deletes) to a temp
+// directory, then loads them as startup does, once serially and once with
+// a scan thread per extra core (at least one), each in a fresh process. Prints the time of
+// each phase and fails if the two loads end up with different bins.
+int runLoadBench(int argc, char* argv[]) {
+    const int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int bins = 1000000;
+    int journal = 100000;
+    int shards = cores;
+
+    if (!parseToolOptions(argc, argv, "load-bench", {
+        {"--bins", intOption(bins)},
+        {"--journal", intOption(journal)},
+        {"--shards", intOption(shards)},
+    })) {
+        return 2;
+    }
+    if (bins < 1 || journal < 0 || shards < 1) {
+        std::cerr << "load-bench needs bins and shards of at least 1" << std::endl;
+        return 2;
+    }
+
+    const std::string dir = enterTempDirectory("smws-load");
+    if (dir.empty()) {
+        return 1;
+    }
+    auto removeDirectory = [&dir] { removeTempDirectory(dir); };
+
+    // Generate the data set; "<snapshot bytes> <journal bytes>"
+    auto started = std::chrono::steady_clock::now();
+    const std::string generated = runInChild([&] {
+        std::mt19937 rng(42);
+        std::uniform_int_distribution<int> fillDist(0, 100);
+        const int64_t base = 1767225600000;  // 2026-01-01T00:00:00Z
+
+        BinTable table;
+        table.reserve(static_cast<size_t>(bins));
+        for (int id = 1; id <= bins; id++) {
+            WasteBin bin(id, std::to_string(id % 5000) + " Main St, District " + std::to_string(id % 40), fillDist(rng));
+            bin.needsCollection = bin.fillLevel >= COLLECTION_THRESHOLD;
+            bin.lastUpdated = base + id;
+            table.insert(bin);
+        }
+        const std::string snapshot = encodeBinarySnapshot([&table](auto&& fn) {
+            for (const auto& bin : table) {
+                fn(bin);
+            }
+        }, static_cast<int64_t>(bins) + 1);
+        if (!writeFileDurably(SNAPSHOT_FILE, snapshot)) {
+            throw std::runtime_error("cannot write the snapshot");
+        }
+
+        // Updates to random bins, plus an add and a delete in every ten records
+        ShardedBins layout(static_cast<size_t>(shards));
+        std::vector<std::string> segments(static_cast<size_t>(shards));
+        std::uniform_int_distribution<int> idDist(1, bins);
+        int nextId = bins + 1;
+        size_t journalBytes = 0;
+        for (int i = 0; i < journal; i++) {
+            const int64_t ts = base + bins + i;
+            json record;
+            if (i % 10 == 0) {
+                WasteBin bin(nextId++, "Added bin, District " + std::to_string(i % 40), fillDist(rng));
+                bin.lastUpdated = ts;
+                record = journalAddRecord(bin);
+            } else if (i % 10 == 5) {
+                record = journalDeleteRecord(idDist(rng), formatTimestamp(ts));
+            } else {
+                const int fill = fillDist(rng);
+                record = makeJournalRecord("update", idDist(rng), {
+                    {"fillLevel", fill},
+                    {"needsCollection", fill >= COLLECTION_THRESHOLD},
+                    {"lastUpdated", formatTimestamp(ts)}
+                }, formatTimestamp(ts));
+            }
+            std::string& segment = segments[layout.shardForId(record["id"].get<int>())];
+            segment += record.dump();
+            segment += '\n';
+        }
+        for (size_t shard = 0; shard < segments.size(); shard++) {
+            journalBytes += segments[shard].size();
+            if (!writeFileDurably(journalSegmentPath(shard), segments[shard])) {
+                throw std::runtime_error("cannot write a journal segment");
+            }
+        }
+        return std::to_string(snapshot.size()) + " " + std::to_string(journalBytes);
+    });
+    if (generated.empty()) {
+        std::cerr << "Could not generate the data set in " << dir << std::endl;
+        removeDirectory();
+        return 1;
+    }
+    size_t snapshotBytes = 0;
+    size_t journalBytes = 0;
+    std::istringstream(generated) >> snapshotBytes >> journalBytes;
+    std::cout << std::fixed << std::setprecision(1)
+              << bins << " bins, " << journal << " journal records, " << shards << " shards; generated "
+              << snapshotBytes / 1000000.0 << " MB of snapshot and " << journalBytes / 1000000.0
+              << " MB of journal in " << elapsedMillis(started) << " ms" << std::endl;
+
+    // Load as startup does; "<snapshot ms> <replay ms> <publish ms> <bins> <checksum>"
+    auto load = [&](size_t threads) {
+        return runInChild([&] {
+            g_store.init(static_cast<size_t>(shards), threads, 0, RollupRetention{});
+            ShardedBins loaded(static_cast<size_t>(shards));
+
+            auto phase = std::chrono::steady_clock::now();
+            if (!loadBinarySnapshot(SNAPSHOT_FILE, loaded)) {
+                throw std::runtime_error("snapshot is missing");
+            }
+            const long long snapshotMs = elapsedMillis(phase);
+            phase = std::chrono::steady_clock::now();
+            replayJournals(loaded, findJournalFiles(static_cast<size_t>(shards)).replayOrder);
+            const long long replayMs = elapsedMillis(phase);
+            phase = std::chrono::steady_clock::now();
+            g_store.replace(loaded);
+            const long long publishMs = elapsedMillis(phase);
+
+            // Order-independent digest of the loaded bins
+            uint64_t checksum = 0;
+            size_t count = 0;
+            g_store.read([&](const BinSnapshot& snapshot) {
+                snapshot.forEach([&](const BinTable::Row& bin) {
+                    const std::string_view location = bin.location();
+                    uint64_t fields[3] = {static_cast<uint64_t>(bin.id()),
+                                          static_cast<uint64_t>(bin.fillLevel()) << 1 | bin.needsCollection(),
+                                          static_cast<uint64_t>(bin.lastUpdatedMs())};
+                    checksum += fnv1aChecksum(reinterpret_cast<const char*>(fields), sizeof(fields)) ^
+                                fnv1aChecksum(location.data(), location.size());
+                    count++;
+                });
+            });
+            return std::to_string(snapshotMs) + " " + std::to_string(replayMs) + " " + std::to_string(publishMs) +
+                   " " + std::to_string(count) + " " + std::to_string(checksum);
+        });
+    };
+
+    std::cout << std::setw(10) << "load" << std::setw(9) << "threads" << std::setw(13) << "snapshot ms"
+              << std::setw(11) << "replay ms" << std::setw(12) << "publish ms" << std::setw(10) << "total ms"
+              << std::setw(10) << "bins" << std::endl;
+    std::vector<std::string> digests;
+    for (const size_t threads : {size_t(0), static_cast<size_t>(std::max(1, cores - 1))}) {
+        const std::string result = load(threads);
+        if (result.empty()) {
+            std::cerr << "Load with " << threads << " scan threads failed" << std::endl;
+            removeDirectory();
+            return 1;
+        }
+        long long snapshotMs = 0, replayMs = 0, publishMs = 0;
+        size_t count = 0;
+        std::string checksum;
+        std::istringstream(result) >> snapshotMs >> replayMs >> publishMs >> count >> checksum;
+        std::cout << std::setw(10) << (threads == 0 ? "serial" : "parallel") << std::setw(9) << threads
+                  << std::setw(13) << snapshotMs << std::setw(11) << replayMs << std::setw(12) << publishMs
+                  << std::setw(10) << snapshotMs + replayMs + publishMs << std::setw(10) << count << std::endl;
+        digests.push_back(std::to_string(count) + " " + checksum);
+    }
+    removeDirectory();
+
+    if (digests.front() != digests.back()) {
+        std::cerr << "Serial and parallel loads produced different bins" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Concurrency stress test against a running server:
+//   smart_waste_server stress-test [--host=127.0.0.1] [--port=8080]
+//       [--threads=16] [--seconds=10] [--bins=200]
+// Seeds bins, then every thread sends a random mix of requests to every
+// endpoint except load-data and import-data (which replace the data set)
+// until the time is up. Fails on a connection error, a status the
+// endpoint should not return, a body that is not the {"success",...}
+// envelope (for /health, a status other than "ok"), or a final bin count
+// that does not match the creates and deletes that succeeded.
+int runStressTest(int argc, char* argv[]) {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    int threads = 16;
+    int seconds = 10;
+    int seedBins = 200;
+
+    if (!parseToolOptions(argc, argv, "stress-test", {
+        {"--host", [&host](const std::string& value) { host = value; }},
+        {"--port", intOption(port)},
+        {"--threads", intOption(threads)},
+        {"--seconds", intOption(seconds)},
+        {"--bins", intOption(seedBins)},
+    })) {
+        return 2;
+    }
+    if (threads < 1 || seconds < 1 || seedBins < 1) {
+        std::cerr << "stress-test needs threads, seconds and bins of at least 1" << std::endl;
+        return 2;
+    }
+
+    struct Endpoint {
+        const char* name;
+        std::vector<int> statuses;  // Expected; 404 where another thread may have deleted the bin
+        uint64_t requests = 0;
+        uint64_t failures = 0;
+        double totalMs = 0;
+        double maxMs = 0;
+    };
+    enum Op {
+        GET_ALL, GET_FILTERED, GET_PAGE, GET_ONE, GET_HISTORY, CREATE, UPDATE, DELETE_ONE, READINGS,
+        COLLECT, ROUTE, STATS, ROLLUPS, MEMORY, HEALTH, SAVE, EXPORT, OP_COUNT
+    };
+    std::vector<Endpoint> endpoints = {
+        {"GET /bins", {200}}, {"GET /bins?filters", {200}}, {"GET /bins?limit", {200}},
+        {"GET /bins/{id}", {200, 404}}, {"GET /bins/{id}/history", {200, 404}}, {"POST /bins", {201}},
+        {"PUT /bins/{id}", {200, 404}}, {"DELETE /bins/{id}", {200, 404}}, {"POST /bins/readings", {200}},
+        {"POST /bins/collect-sensor-data", {200}}, {"GET /optimize-route", {200}}, {"GET /dashboard/stats", {200}},
+        {"GET /dashboard/rollups", {200}}, {"GET /admin/memory", {200}}, {"GET /health", {200}},
+        {"POST /admin/save-data", {200}}, {"POST /admin/export-data", {200}},
+    };
+    // Relative frequency of each operation: mostly reads and single-bin writes
+    const std::vector<int> weights = {2, 4, 4, 20, 4, 8, 20, 4, 8, 1, 2, 4, 2, 1, 2, 1, 1};
+
+    // Envelope of a response, or a description of what is wrong with it
+    auto checkBody = [](const httplib::Result& result, json& body) -> std::string {
+        try {
+            body = json::parse(result->body);
+        }
+        catch (const std::exception& e) {
+            return std::string("body is not JSON: ") + e.what();
+        }
+        if (!body.is_object() || !body.contains("success") || !body["success"].is_boolean() ||
+            !body.contains("message")) {
+            return "body is not a response envelope";
+        }
+        if (body["success"].get<bool>() != (result->status < 400)) {
+            return "success does not match the status";
+        }
+        return "";
+    };
+    // /health answers {"status","timestamp","version"} rather than an envelope
+    auto checkHealth = [](const httplib::Result& result) -> std::string {
+        try {
+            json body = json::parse(result->body);
+            if (!body.is_object() || body.value("status", "") != "ok") {
+                return "health status is not ok";
+            }
+        }
+        catch (const std::exception& e) {
+            return std::string("body is not JSON: ") + e.what();
+        }
+        return "";
+    };
+    auto countBins = [&checkBody](httplib::Client& client, size_t& count) {
+        auto result = client.Get("/bins");
+        json body;
+        if (!result || result->status != 200 || !checkBody(result, body).empty() || !body["data"].is_array()) {
+            return false;
+        }
+        count = body["data"].size();
+        return true;
+    };
+
+    httplib::Client setup(host, port);
+    size_t initialBins = 0;
+    if (!countBins(setup, initialBins)) {
+        std::cerr << "Could not list bins on " << host << ":" << port << std::endl;
+        return 1;
+    }
+    json seed = json::array();
+    for (int i = 0; i < seedBins; i++) {
+        seed.push_back({{"location", "Stress " + std::to_string(i)}});
+    }
+    auto seeded = setup.Post("/bins", seed.dump(), "application/json");
+    json seedBody;
+    if (!seeded || seeded->status != 201 || !checkBody(seeded, seedBody).empty()) {
+        std::cerr << "Could not create the seed bins" << std::endl;
+        return 1;
+    }
+    std::atomic<int> maxId{0};
+    for (const auto& bin : seedBody["data"]) {
+        maxId = std::max(maxId.load(), bin["id"].get<int>());
+    }
+
+    std::atomic<int64_t> created{seedBins};
+    std::atomic<int64_t> deleted{0};
+    std::mutex resultsMutex;
+    std::vector<std::string> errors;
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+
+    auto worker = [&](int index) {
+        httplib::Client client(host, port);
+        std::mt19937 rng = workerRng(index);
+        std::discrete_distribution<int> opDist(weights.begin(), weights.end());
+        std::uniform_int_distribution<int> fillDist(0, 100);
+        std::vector<Endpoint> local = endpoints;
+        auto randomId = [&] { return std::uniform_int_distribution<int>(1, std::max(1, maxId.load()))(rng); };
+
+        while (std::chrono::steady_clock::now() < deadline) {
+            const Op op = static_cast<Op>(opDist(rng));
+            const auto start = std::chrono::steady_clock::now();
+            httplib::Result result = [&]() -> httplib::Result {
+                const std::string bin = "/bins/" + std::to_string(randomId());
+                switch (op) {
+                    case GET_ALL: return client.Get("/bins");
+                    case GET_FILTERED:
+                        return client.Get("/bins?needsCollection=" + std::string(rng() % 2 ? "true" : "false") +
+                                          "&minFill=" + std::to_string(fillDist(rng) / 2) + "&fields=id,fillLevel");
+                    case GET_PAGE:
+                        return client.Get("/bins?limit=50&cursor=" + std::to_string(randomId()));
+                    case GET_ONE: return client.Get(bin);
+                    case GET_HISTORY: return client.Get(bin + "/history?interval=60");
+                    case CREATE:
+                        return client.Post("/bins", json{{"location", "Stress " + std::to_string(index)}}.dump(),
+                                           "application/json");
+                    case UPDATE:
+                        return client.Put(bin, json{{"fillLevel", fillDist(rng)}}.dump(), "application/json");
+                    case DELETE_ONE: return client.Delete(bin);
+                    case READINGS: {
+                        json readings = json::array();
+                        for (int i = 0; i < 50; i++) {
+                            readings.push_back({{"binId", randomId()}, {"fillLevel", fillDist(rng)}});
+                        }
+                        return client.Post("/bins/readings", json{{"readings", readings}}.dump(), "application/json");
+                    }
+                    case COLLECT: return client.Post("/bins/collect-sensor-data", "", "application/json");
+                    case ROUTE: return client.Get("/optimize-route");
+                    case STATS: return client.Get("/dashboard/stats");
+                    case ROLLUPS: return client.Get("/dashboard/rollups?resolution=hour");
+                    case MEMORY: return client.Get("/admin/memory");
+                    case HEALTH: return client.Get("/health");
+                    case SAVE: return client.Post("/admin/save-data", "", "application/json");
+                    case EXPORT: return client.Post("/admin/export-data", "", "application/json");
+                    case OP_COUNT: break;
+                }
+                return client.Get("/health");
+            }();
+            const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+            Endpoint& endpoint = local[op];
+            endpoint.requests++;
+            endpoint.totalMs += ms;
+            endpoint.maxMs = std::max(endpoint.maxMs, ms);
+
+            std::string error;
+            json body;
+            if (!result) {
+                error = "request failed: " + httplib::to_string(result.error());
+            } else if (std::find(endpoint.statuses.begin(), endpoint.statuses.end(), result->status) == endpoint.statuses.end()) {
+                error = "unexpected status " + std::to_string(result->status) + ": " + result->body.substr(0, 200);
+            } else {
+                error = op == HEALTH ? checkHealth(result) : checkBody(result, body);
+            }
+            if (!error.empty()) {
+                endpoint.failures++;
+                std::lock_guard<std::mutex> lock(resultsMutex);
+                errors.push_back(std::string(endpoint.name) + ": " + error);
+                continue;
+            }
+
+            if (op == CREATE) {
+                created++;
+                const int id = body["data"][0]["id"].get<int>();
+                int seen = maxId.load();
+                while (seen < id && !maxId.compare_exchange_weak(seen, id)) {
+                }
+            } else if (op == DELETE_ONE && result->status == 200) {
+                deleted++;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(resultsMutex);
+        for (size_t i = 0; i < endpoints.size(); i++) {
+            endpoints[i].requests += local[i].requests;
+            endpoints[i].failures += local[i].failures;
+            endpoints[i].totalMs += local[i].totalMs;
+            endpoints[i].maxMs = std::max(endpoints[i].maxMs, local[i].maxMs);
+        }
+    };
+
+    const double elapsed = runWorkers(threads, worker);
+
+    // Every successful create and delete must be reflected in the list and
+    // in the dashboard totals
+    size_t finalBins = 0;
+    const size_t expectedBins = initialBins + static_cast<size_t>(created.load() - deleted.load());
+    if (!countBins(setup, finalBins)) {
+        errors.push_back("could not list bins after the run");
+    } else if (finalBins != expectedBins) {
+        errors.push_back("GET /bins returns " + std::to_string(finalBins) + " bins, expected " + std::to_string(expectedBins));
+    }
+    auto stats = setup.Get("/dashboard/stats");
+    json statsBody;
+    if (!stats || stats->status != 200 || !checkBody(stats, statsBody).empty()) {
+        errors.push_back("could not read the dashboard stats after the run");
+    } else if (statsBody["data"]["totalBins"].get<size_t>() != expectedBins) {
+        errors.push_back("GET /dashboard/stats counts " + statsBody["data"]["totalBins"].dump() + " bins, expected " +
+                         std::to_string(expectedBins));
+    }
+
+    uint64_t total = 0;
+    std::cout << std::fixed << std::setprecision(2);
+    for (const auto& endpoint : endpoints) {
+        total += endpoint.requests;
+        std::cout << std::setw(32) << std::left << endpoint.name << std::right << std::setw(9) << endpoint.requests
+                  << " requests " << std::setw(6) << endpoint.failures << " failed  avg "
+                  << std::setw(8) << (endpoint.requests > 0 ? endpoint.totalMs / endpoint.requests : 0.0)
+                  << " ms  max " << std::setw(9) << endpoint.maxMs << " ms" << std::endl;
+    }
+    std::cout << total << " requests from " << threads << " threads in " << elapsed << " s ("
+              << std::setprecision(0) << total / elapsed << " requests/s); " << created.load() << " bins created, "
+              << deleted.load() << " deleted, " << finalBins << " listed" << std::endl;
+
+    for (size_t i = 0; i < errors.size() && i < 20; i++) {
+        std::cerr << errors[i] << std::endl;
+    }
+    if (!errors.empty()) {
+        std::cerr << errors.size() << " errors" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Crash-recovery check for journal rotation:
+//   smart_waste_server journal-check
+// In a temp directory, rotates a journal segment with and without a
+// .compacting segment left over by an unfinished compaction, and with the
+// live segment missing, empty or holding records, and checks the rotated
+// segment holds exactly the records of both, in order. Each case rotates
+// twice, since one failed rotation would fail every later compaction.
+int runJournalCheck(int argc, char* argv[]) {
+    if (!parseToolOptions(argc, argv, "journal-check", {})) {
+        return 2;
+    }
+
+    const std::string dir = enterTempDirectory("smws-journal");
+    if (dir.empty()) {
+        return 1;
+    }
+
+    // The large live segment spans several copy buffers
+    std::string large;
+    for (int record = 0; large.size() < 200 * 1024; record++) {
+        large += "{\"op\":" + std::to_string(record) + "}\n";
+    }
+    struct Case {
+        const char* name;
+        bool leftover;  // A .compacting segment is left over
+        std::string compacting;
+        bool live;      // The live segment exists
+        std::string records;
+    };
+    const std::string first = "{\"op\":1}\n";
+    const std::string second = "{\"op\":2}\n";
+    const std::vector<Case> cases = {
+        {"no segments", false, "", false, ""},
+        {"live segment only", false, "", true, second},
+        {"empty live segment", false, "", true, ""},
+        {"leftover, no live segment", true, first, false, ""},
+        {"leftover, empty live segment", true, first, true, ""},
+        {"leftover and live segment", true, first, true, second},
+        {"empty leftover, live segment", true, "", true, second},
+        {"leftover, large live segment", true, first, true, large},
+    };
+
+    const std::string path = journalSegmentPath(0);
+    const std::string compacting = path + ".compacting";
+    auto writeFile = [](const std::string& file, const std::string& content) {
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        out << content;
+    };
+    auto readFile = [](const std::string& file) {
+        std::ifstream in(file, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    };
+
+    int failures = 0;
+    for (const Case& test : cases) {
+        std::remove(path.c_str());
+        std::remove(compacting.c_str());
+        if (test.leftover) {
+            writeFile(compacting, test.compacting);
+        }
+        if (test.live) {
+            writeFile(path, test.records);
+        }
+        std::string expected = test.compacting + test.records;
+
+        // The second round rotates a fresh live segment onto the result, as
+        // the next compaction would if this one did not finish
+        std::string error;
+        for (int round = 0; round < 2 && error.empty(); round++) {
+            if (round > 0) {
+                writeFile(path, second);
+                expected += second;
+            }
+            if (!rotateJournalSegment(path)) {
+                error = "rotation " + std::to_string(round + 1) + " failed";
+            } else if (::access(path.c_str(), F_OK) == 0) {
+                error = "live segment was left in place";
+            } else if (readFile(compacting) != expected) {
+                error = "rotated segment holds " + std::to_string(readFile(compacting).size()) +
+                        " bytes, expected " + std::to_string(expected.size());
+            }
+        }
+        std::cout << std::setw(32) << std::left << test.name << std::right << (error.empty() ? "ok" : error)
+                  << std::endl;
+        if (!error.empty()) {
+            failures++;
+        }
+    }
+    removeTempDirectory(dir);
+
+    if (failures > 0) {
+        std::cerr << failures << " of " << cases.size() << " cases failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
+
+// Compatibility check and micro-benchmark for the direct JSON writers:
+//   smart_waste_server json-check [--bins=10000] [--rounds=20]
+// Renders random bins, with locations full of characters that need
+// escaping and every field projection, through WasteBin::appendJson, the
+// cached BinTable fragments and the createApiResponse envelope, and checks
+// each against nlohmann::json::dump() of the equivalent tree. Then times
+// a GET /bins style body built both ways.
+int runJsonCheck(int argc, char* argv[]) {
+    int binCount = 10000;
+    int rounds = 20;
+
+    if (!parseToolOptions(argc, argv, "json-check", {
+        {"--bins", intOption(binCount)},
+        {"--rounds", intOption(rounds)},
+    })) {
+        return 2;
+    }
+    if (binCount < 1 || rounds < 1) {
+        std::cerr << "json-check needs bins and rounds of at least 1" << std::endl;
+        return 2;
+    }
+
+    // Every control character, quotes, backslashes, DEL and multi-byte
+    // UTF-8 (dump() rejects invalid UTF-8, so none is generated)
+    std::vector<std::string> pieces = {"", "Main St", "\"", "\\", "/", "\x7f", "caf\xc3\xa9",
+                                       "\xe2\x82\xac", "\xf0\x9f\x97\x91", "\\u0041", " "};
+    for (int c = 0; c < 0x20; c++) {
+        pieces.push_back(std::string(1, static_cast<char>(c)));
+    }
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> pieceDist(0, pieces.size() - 1);
+    std::uniform_int_distribution<int> lengthDist(0, 6);
+    std::uniform_int_distribution<int> fillDist(0, 100);
+    std::uniform_int_distribution<int64_t> timeDist(-62135596800000, 253402300799999);  // Years 1 to 9999
+    std::vector<WasteBin> bins;
+    bins.reserve(static_cast<size_t>(binCount));
+    for (int i = 0; i < binCount; i++) {
+        std::string location;
+        for (int n = lengthDist(rng); n > 0; n--) {
+            location += pieces[pieceDist(rng)];
+        }
+        WasteBin bin(i % 2 == 0 ? i + 1 : std::numeric_limits<int>::max() - i, location, fillDist(rng), rng() % 2 == 0);
+        bin.lastUpdated = i % 16 == 0 ? 0 : timeDist(rng);
+        bins.push_back(bin);
+    }
+
+    size_t checks = 0;
+    size_t mismatches = 0;
+    auto check = [&](const char* what, const std::string& expected, const std::string& actual) {
+        checks++;
+        if (expected != actual && mismatches++ < 5) {
+            const size_t at = std::mismatch(expected.begin(), expected.end(), actual.begin(), actual.end()).first -
+                              expected.begin();
+            const size_t from = at < 40 ? 0 : at - 40;
+            std::cerr << what << " differs at byte " << at << ":\n  dump():  " << expected.substr(from, 80)
+                      << "\n  direct:  " << actual.substr(from, 80) << std::endl;
+        }
+    };
+
+    // Single bins, every projection
+    const char* const keys[] = {"id", "location", "fillLevel", "needsCollection", "lastUpdated"};
+    const unsigned fieldBits[] = {WasteBin::FIELD_ID, WasteBin::FIELD_LOCATION, WasteBin::FIELD_FILL_LEVEL,
+                                  WasteBin::FIELD_NEEDS_COLLECTION, WasteBin::FIELD_LAST_UPDATED};
+    std::string out;
+    for (const WasteBin& bin : bins) {
+        for (unsigned fields = 0; fields <= WasteBin::ALL_FIELDS; fields++) {
+            json expected = bin.toJson();
+            for (size_t k = 0; k < 5; k++) {
+                if (!(fields & fieldBits[k])) {
+                    expected.erase(keys[k]);
+                }
+            }
+            out.clear();
+            bin.appendJson(out, fields);
+            check("WasteBin::appendJson", expected.dump(), out);
+        }
+    }
+
+    // Cached fragments of a bin table, and the response envelope
+    BinTable table;
+    json legacyArray = json::array();
+    for (const WasteBin& bin : bins) {
+        table.insert(bin);
+        legacyArray.push_back(bin.toJson());
+    }
+    table.refreshFragments();
+    const BinTable& rows = table;
+    for (const std::string& message : {std::string("Retrieved bins"), pieces[12] + "\"quoted\"\n" + pieces[7]}) {
+        for (bool success : {true, false}) {
+            json legacy = {{"success", success}, {"message", message}, {"data", legacyArray}};
+            check("createApiResponse(bins)", legacy.dump(),
+                  createApiResponse(success, message, [&rows](std::string& body) { appendBinArray(body, rows); }));
+            json bare = {{"success", success}, {"message", message}};
+            check("createApiResponse()", bare.dump(), createApiResponse(success, message));
+        }
+    }
+
+    // Time the GET /bins body both ways: the json tree as handlers used to
+    // build it, and the direct writer into a reused buffer
+    auto time = [rounds](const std::function<size_t()>& render) {
+        size_t bytes = render();  // Warm up
+        const auto start = std::chrono::steady_clock::now();
+        for (int round = 0; round < rounds; round++) {
+            bytes = render();
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / rounds;
+        return std::make_pair(seconds, bytes);
+    };
+    const auto legacy = time([&bins] {
+        json data = json::array();
+        for (const WasteBin& bin : bins) {
+            data.push_back(bin.toJson());
+        }
+        json response = {{"success", true}, {"message", "Retrieved bins"}, {"data", data}};
+        return response.dump().size();
+    });
+    std::string buffer;
+    const auto direct = time([&bins, &buffer] {
+        buffer.clear();
+        appendApiResponse(buffer, true, "Retrieved bins", [&bins](std::string& body) { appendBinArray(body, bins); });
+        return buffer.size();
+    });
+    const auto cached = time([&rows, &buffer] {
+        buffer.clear();
+        appendApiResponse(buffer, true, "Retrieved bins", [&rows](std::string& body) { appendBinArray(body, rows); });
+        return buffer.size();
+    });
+
+    std::cout << std::fixed << std::setprecision(2) << checks << " outputs compared, " << mismatches << " mismatches\n";
+    auto report = [&legacy](const char* name, const std::pair<double, size_t>& result) {
+        std::cout << std::setw(22) << std::left << name << std::right << std::setw(10) << result.first * 1e3 << " ms  "
+                  << std::setw(10) << result.second / result.first / 1e6 << " MB/s  "
+                  << std::setw(6) << legacy.first / result.first << "x" << std::endl;
+    };
+    std::cout << binCount << " bins, " << legacy.second << " bytes per body, mean of " << rounds << " rounds" << std::endl;
+    report("json tree + dump()", legacy);
+    report("direct writer", direct);
+    report("cached fragments", cached);
+    return mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    // Bundled tools run instead of the server
+    if (argc > 1 && std::string(argv[1]) == "ingest-load") {
+        return runIngestLoad(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "history-bench") {
+        return runHistoryBench(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "scan-bench") {
+        return runScanBench(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "load-bench") {
+        return runLoadBench(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "stress-test") {
+        return runStressTest(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "json-check") {
+        return runJsonCheck(argc - 2, argv + 2);
+    }
+    if (argc > 1 && std::string(argv[1]) == "journal-check") {
+        return runJournalCheck(argc - 2, argv + 2);
+    }
+
+    // Split the store into shards; by default one shard and one scan thread per core
+    int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int shardCount = getEnvInt("SMWS_SHARDS", cores);
+    if (shardCount < 1) {
+        std::cerr << "SMWS_SHARDS must be at least 1" << std::endl;
+        return 1;
+    }
+    const int historySamples = std::max(0, getEnvInt("SMWS_HISTORY_SAMPLES", 64));
+    RollupRetention rollupRetention;
+    rollupRetention.hours = static_cast<size_t>(std::max(0, getEnvInt("SMWS_ROLLUP_HOURS", 48)));
+    rollupRetention.days = static_cast<size_t>(std::max(0, getEnvInt("SMWS_ROLLUP_DAYS", 90)));
+    g_store.init(static_cast<size_t>(shardCount), static_cast<size_t>(std::max(0, getEnvInt("SMWS_SCAN_THREADS", cores - 1))),
+                 static_cast<size_t>(historySamples), rollupRetention);
+
+    // Storage backend: "journal" (binary snapshot plus journal segments) or
+    // "mmap" (mapped table of fixed-size records, updated in place)
+    const std::string storage = getEnvString("SMWS_STORAGE", "journal");
+    if (storage != "journal" && storage != "mmap") {
+        std::cerr << "Unknown SMWS_STORAGE '" << storage << "' (expected journal or mmap)" << std::endl;
+        return 1;
+    }
+
+    // A new mapped table is seeded from the snapshot and journal (and an
+    // import builds its replacement) under a temporary name, so a crash
+    // while building leaves no partial table
+    if (storage == "mmap") {
+        MappedBinTable::finishRename(TABLE_FILE + ".new", TABLE_FILE);
+    }
+    const bool seedTable = storage == "mmap" && ::access(TABLE_FILE.c_str(), F_OK) != 0;
+    if (storage == "mmap") {
+        try {
+            g_mappedTable.open(seedTable ? TABLE_FILE + ".new" : TABLE_FILE);
+        }
+        catch (const std::exception& e) {
+            std::cerr << "Refusing to start: " << e.what() << std::endl;
+            return 1;
+        }
+        if (!seedTable) {
+            g_store.persistTo(&g_mappedTable);
+        }
+    }
+
+    // Load data on startup
+    std::vector<ReplayedReading> replayedReadings;
+    if (!loadBinsFromFile(&replayedReadings)) {
+        std::cerr << "Refusing to start with unreadable bin data" << std::endl;
+        return 1;
+    }
+
+    // Sealed fill-level history, kept whenever history is enabled. Opened
+    // after the load, whose replace() would otherwise discard it.
+    if (historySamples > 0 && !g_historyArchive.open(HISTORY_FILE)) {
+        std::cerr << "Refusing to start without the history archive" << std::endl;
+        return 1;
+    }
+    if (!loadRollups(replayedReadings)) {
+        std::cerr << "Refusing to start with unreadable rollups" << std::endl;
+        return 1;
+    }
+
+    if (seedTable) {
+        BinSnapshot snapshot = g_store.acquire();
+        if (!g_mappedTable.reset([&snapshot](auto&& fn) { snapshot.forEach(fn); }, g_store.nextId()) ||
+            !g_mappedTable.renameTo(TABLE_FILE)) {
+            std::cerr << "Refusing to start: could not create " << TABLE_FILE << std::endl;
+            return 1;
+        }
+        syncDataDirectory();
+        g_store.persistTo(&g_mappedTable);
+    }
+
+    // Journal durability policy
+    try {
+        g_flusher.configure(
+            parseDurabilityMode(getEnvString("SMWS_DURABILITY", "group")),
+            std::chrono::milliseconds(getEnvInt("SMWS_GROUP_COMMIT_MS", 5)),
+            std::chrono::milliseconds(getEnvInt("SMWS_FLUSH_INTERVAL_S", 1) * 1000));
+    }
+    catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    std::vector<DurableSegment*> segments;
+    if (g_store.mappedTable() != nullptr) {
+        segments.push_back(&g_mappedTable);
+    } else {
+        for (JournalWriter* segment : g_store.journalSegments()) {
+            segments.push_back(segment);
         }
     }
-    catch (const std::exception& e) {
-        std::cerr << "Error loading data: " << e.what() << std::endl;
-        g_bins.clear();
-        g_next_bin_id = 1;
+    g_flusher.start(segments);
+    std::cout << "Storage: " << storage << ", durability mode: " << durabilityModeName(g_flusher.mode())
+              << ", " << g_store.shardCount() << " shards, " << scanKernels().name << " scan kernels" << std::endl;
+
+    // Journals from a different shard layout must be folded into the
+    // snapshot before the new segments start receiving records. A changed
+    // shard count moves ids between all segments, not just the extra ones,
+    // so the snapshot records the layout and any change folds every segment.
+    const bool layoutChanged = g_store.mappedTable() == nullptr &&
+                               snapshotShardCount(SNAPSHOT_FILE) != g_store.shardCount();
+    if ((layoutChanged || !findJournalFiles(g_store.shardCount()).stale.empty()) && !compactBins()) {
+        std::cerr << "Refusing to start: could not fold journals from a previous shard layout" << std::endl;
+        return 1;
     }
-}
 
-// Helper: Save data to file
-void saveBinsToFile() {
-    std::lock_guard<std::mutex> lock(g_file_mutex);
+    // Fold the journal into a fresh snapshot in the background
+    SnapshotCompactor compactor(std::chrono::seconds(getEnvInt("SMWS_COMPACT_INTERVAL_S", 60)),
+                                std::chrono::seconds(getEnvInt("SMWS_ROLLUP_SAVE_INTERVAL_S", 600)));
+    compactor.start();
 
-    try {
-        json data = json::array();
-        for (const auto& bin : g_bins) {
-            data.push_back(bin.toJson());
+    // Binary sensor ingest listener, off unless SMWS_INGEST_PORT is set
+    IngestListener ingest(static_cast<size_t>(std::max(1, getEnvInt("SMWS_INGEST_MAX_CONNECTIONS", 64))),
+                          static_cast<size_t>(std::max(1, getEnvInt("SMWS_INGEST_MAX_INFLIGHT", 200000))));
+    const int ingestPort = getEnvInt("SMWS_INGEST_PORT", 0);
+    if (ingestPort > 0) {
+        try {
+            ingest.start(getEnvString("SMWS_INGEST_HOST", "127.0.0.1"), ingestPort);
         }
-
-        std::ofstream file(DATA_FILE);
-        file << data.dump(4);
-    }
-    catch (const std::exception& e) {
-        std::cerr << "Error saving data: " << e.what() << std::endl;
+        catch (const std::exception& e) {
+            std::cerr << "Refusing to start: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Binary sensor ingest listening on " << ingest.status()["address"].get<std::string>() << std::endl;
     }
-}
-
-int main() {
-    // Load data on startup
-    loadBinsFromFile();
 
     // Create server
     httplib::Server svr;
@@ -175,14 +7505,17 @@ int main() {
             "<p>Version 1.0.0</p>"
             "<h2>Available Endpoints:</h2>"
             "<ul>"
-            "<li><code>GET /bins</code> - List all waste bins</li>"
+            "<li><code>GET /bins</code> - List waste bins (optional cursor, limit, needsCollection, minFill, maxFill, updatedSince, updatedBefore, fields)</li>"
             "<li><code>GET /bins/{id}</code> - Get a specific bin by ID</li>"
+            "<li><code>GET /bins/{id}/history</code> - Fill-level history of a bin (optional from, to, interval)</li>"
             "<li><code>POST /bins</code> - Add new waste bins</li>"
             "<li><code>PUT /bins/{id}</code> - Update a bin's properties</li>"
             "<li><code>DELETE /bins/{id}</code> - Delete a waste bin</li>"
             "<li><code>POST /bins/collect-sensor-data</code> - Simulate sensor data collection</li>"
+            "<li><code>POST /bins/readings</code> - Ingest a batch of sensor readings (binId, fillLevel, sensorTimestamp)</li>"
             "<li><code>GET /optimize-route</code> - Get optimized collection route</li>"
             "<li><code>GET /dashboard/stats</code> - Get dashboard statistics</li>"
+            "<li><code>GET /dashboard/rollups</code> - Hourly or daily fill rollups per district or bin (optional resolution, district, binId, from, to)</li>"
             "<li><code>GET /health</code> - API health check</li>"
             "</ul>"
             "</body></html>",
@@ -191,6 +7524,10 @@ int main() {
 
     // Add new bins
     svr.Post("/bins", [](const httplib::Request& req, httplib::Response& res) {
+        if (refuseWrites(res)) {
+            return;
+        }
+
         try {
             // Parse request body
             json requestData = json::parse(req.body);
@@ -201,104 +7538,217 @@ int main() {
                 requestData.push_back(binData);
             }
 
-            std::vector<WasteBin> created;
+            // Validate every bin before creating any of them
+            std::vector<std::string> locations;
             for (const auto& binData : requestData) {
                 // Get location from request
                 if (!binData.contains("location") || !binData["location"].is_string()) {
                     res.status = 400;
-                    res.set_content(createApiResponse(false, "Each bin must have a location string").dump(), "application/json");
+                    res.set_content(createApiResponse(false, "Each bin must have a location string"), "application/json");
                     return;
                 }
 
-                std::string location = binData["location"].get<std::string>();
+                locations.push_back(binData["location"].get<std::string>());
+            }
 
-                // Create new bin
-                WasteBin newBin(g_next_bin_id++, location);
-                g_bins.push_back(newBin);
-                created.push_back(newBin);
+            // Create new bins, grouped by the shard that owns their id
+            std::vector<WasteBin> created;
+            std::map<size_t, std::vector<const WasteBin*>> byShard;
+            created.reserve(locations.size());
+            for (const auto& location : locations) {
+                created.emplace_back(g_store.allocateId(), location);
+            }
+            for (const auto& bin : created) {
+                byShard[g_store.shardForId(bin.id)].push_back(&bin);
             }
 
-            // Save to file
-            saveBinsToFile();
+            CommitTicket ticket;
+            for (const auto& group : byShard) {
+                g_store.write(group.first, ticket, [&group](ShardWriter& shard) {
+                    std::vector<json> records;
+                    for (const WasteBin* bin : group.second) {
+                        shard.insert(*bin);
+                        records.push_back(journalAddRecord(*bin));
+                    }
 
-            // Convert created bins to JSON array
-            json createdJson = json::array();
-            for (const auto& bin : created) {
-                createdJson.push_back(bin.toJson());
+                    // Persist to journal
+                    shard.journal(records);
+                });
+            }
+            if (!commitMutation(req, ticket, res)) {
+                return;
             }
 
             // Return success response
             res.status = 201;
             res.set_content(
-                createApiResponse(true, std::to_string(created.size()) + " bins added successfully", createdJson).dump(),
+                createApiResponse(true, std::to_string(created.size()) + " bins added successfully",
+                                  [&created](std::string& out) { appendBinArray(out, created); }),
                 "application/json"
             );
         }
         catch (const std::exception& e) {
             res.status = 400;
             res.set_content(
-                createApiResponse(false, std::string("Error: ") + e.what()).dump(),
+                createApiResponse(false, std::string("Error: ") + e.what()),
                 "application/json"
             );
         }
     });
 
     // Get all bins
-    svr.Get("/bins", [](const httplib::Request&, httplib::Response& res) {
-        if (g_bins.empty()) {
+    svr.Get("/bins", [](const httplib::Request& req, httplib::Response& res) {
+        BinQuery query;
+        std::string error;
+        if (!BinQuery::parse(req, query, error)) {
+            res.status = 400;
+            res.set_content(createApiResponse(false, error), "application/json");
+            return;
+        }
+
+        streamBinsResponse(res, g_store.acquire(), query);
+    });
+
+    // Get bin by ID
+    svr.Get(R"(/bins/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
+        int binId = std::stoi(req.matches[1]);
+
+        std::string binJson = g_store.read([binId](const BinSnapshot& bins) {
+            std::string out;
+            if (BinTable::Row bin = bins.find(binId)) {
+                bin.appendJson(out);
+            }
+            return out;
+        });
+
+        if (!binJson.empty()) {
             res.set_content(
-                createApiResponse(true, "No bins available", json::array()).dump(),
+                createApiResponse(true, "Retrieved bin with ID " + std::to_string(binId),
+                                  [&binJson](std::string& out) { out += binJson; }),
                 "application/json"
             );
             return;
         }
 
-        json binsJson = json::array();
-        for (const auto& bin : g_bins) {
-            binsJson.push_back(bin.toJson());
-        }
-
+        res.status = 404;
         res.set_content(
-            createApiResponse(true, "Retrieved " + std::to_string(g_bins.size()) + " bins", binsJson).dump(),
+            createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found"),
             "application/json"
         );
     });
 
-    // Get bin by ID
-    svr.Get(R"(/bins/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
+    // Fill-level history of a bin, optionally limited to a time range and
+    // downsampled into fixed-width buckets
+    svr.Get(R"(/bins/(\d+)/history)", [](const httplib::Request& req, httplib::Response& res) {
         int binId = std::stoi(req.matches[1]);
 
-        for (const auto& bin : g_bins) {
-            if (bin.id == binId) {
-                res.set_content(
-                    createApiResponse(true, "Retrieved bin with ID " + std::to_string(binId), bin.toJson()).dump(),
-                    "application/json"
-                );
-                return;
+        HistoryQuery query;
+        std::string error;
+        if (!HistoryQuery::parse(req, query, error)) {
+            res.status = 400;
+            res.set_content(createApiResponse(false, error), "application/json");
+            return;
+        }
+
+        bool found = g_store.read([binId](const BinSnapshot& bins) {
+            return static_cast<bool>(bins.find(binId));
+        });
+        if (!found) {
+            res.status = 404;
+            res.set_content(
+                createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found"),
+                "application/json"
+            );
+            return;
+        }
+
+        const FillHistory& history = g_store.historyForId(binId);
+        json data = {
+            {"binId", binId},
+            {"capacity", history.capacity()}
+        };
+        size_t count = 0;
+
+        if (query.intervalMs == 0) {
+            json samples = json::array();
+            history.forEachSample(binId, query.from, query.to, [&](const FillHistory::Sample& sample) {
+                samples.push_back({
+                    {"timestamp", formatTimestamp(sample.timestamp)},
+                    {"fillLevel", sample.fillLevel}
+                });
+            });
+            count = samples.size();
+            data["samples"] = std::move(samples);
+        } else {
+            struct Bucket {
+                int64_t start;
+                int min, max, last, samples;
+                int64_t sum;
+            };
+            std::vector<Bucket> buckets;
+            history.forEachSample(binId, query.from, query.to, [&](const FillHistory::Sample& sample) {
+                // Floor to the bucket boundary, also for times before the epoch
+                int64_t start = sample.timestamp - ((sample.timestamp % query.intervalMs) + query.intervalMs) % query.intervalMs;
+                if (buckets.empty() || buckets.back().start != start) {
+                    buckets.push_back({start, sample.fillLevel, sample.fillLevel, sample.fillLevel, 0, 0});
+                }
+                Bucket& bucket = buckets.back();
+                bucket.min = std::min(bucket.min, sample.fillLevel);
+                bucket.max = std::max(bucket.max, sample.fillLevel);
+                bucket.last = sample.fillLevel;
+                bucket.samples++;
+                bucket.sum += sample.fillLevel;
+            });
+
+            json items = json::array();
+            for (const auto& bucket : buckets) {
+                double average = static_cast<double>(bucket.sum) / bucket.samples;
+                items.push_back({
+                    {"timestamp", formatTimestamp(bucket.start)},
+                    {"min", bucket.min},
+                    {"max", bucket.max},
+                    {"avg", round(average * 10) / 10.0},  // Round to 1 decimal place
+                    {"last", bucket.last},
+                    {"samples", bucket.samples}
+                });
             }
+            count = items.size();
+            data["interval"] = query.intervalSeconds;
+            data["buckets"] = std::move(items);
         }
 
-        res.status = 404;
         res.set_content(
-            createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found").dump(),
+            createApiResponse(true, "Retrieved " + std::to_string(count) + (query.intervalMs == 0 ? " samples" : " buckets") +
+                                    " for bin " + std::to_string(binId), data),
             "application/json"
         );
     });
 
     // Delete bin by ID
     svr.Delete(R"(/bins/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
+        if (refuseWrites(res)) {
+            return;
+        }
+
         int binId = std::stoi(req.matches[1]);
 
-        auto it = std::find_if(g_bins.begin(), g_bins.end(), [binId](const WasteBin& bin) {
-            return bin.id == binId;
+        std::string timestamp = formatTimestamp(currentTimeMillis());
+        CommitTicket ticket;
+        bool deleted = g_store.write(g_store.shardForId(binId), ticket, [&](ShardWriter& shard) {
+            if (!shard.erase(binId)) {
+                return false;
+            }
+            shard.journal(journalDeleteRecord(binId, timestamp));
+            return true;
         });
 
-        if (it != g_bins.end()) {
-            g_bins.erase(it);
-            saveBinsToFile();
+        if (deleted) {
+            if (!commitMutation(req, ticket, res)) {
+                return;
+            }
 
             res.set_content(
-                createApiResponse(true, "Bin with ID " + std::to_string(binId) + " deleted successfully").dump(),
+                createApiResponse(true, "Bin with ID " + std::to_string(binId) + " deleted successfully"),
                 "application/json"
             );
             return;
@@ -306,42 +7756,65 @@ int main() {
 
         res.status = 404;
         res.set_content(
-            createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found").dump(),
+            createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found"),
             "application/json"
         );
     });
 
     // Update bin by ID
     svr.Put(R"(/bins/(\d+))", [](const httplib::Request& req, httplib::Response& res) {
+        if (refuseWrites(res)) {
+            return;
+        }
+
         try {
             int binId = std::stoi(req.matches[1]);
             json updateData = json::parse(req.body);
 
-            auto it = std::find_if(g_bins.begin(), g_bins.end(), [binId](const WasteBin& bin) {
-                return bin.id == binId;
-            });
+            // Timestamp taken outside the lock
+            int64_t timestamp = currentTimeMillis();
+            std::string updatedJson;
+            CommitTicket ticket;
+            bool updated = g_store.write(g_store.shardForId(binId), ticket, [&](ShardWriter& shard) {
+                BinTable::RowRef it = shard.find(binId);
+                if (!it) {
+                    return false;
+                }
+
+                json changed = json::object();
 
-            if (it != g_bins.end()) {
                 // Update only provided fields
                 if (updateData.contains("location") && updateData["location"].is_string()) {
-                    it->location = updateData["location"].get<std::string>();
+                    it.setLocation(updateData["location"].get<std::string>());
+                    changed["location"] = it.location();
                 }
 
                 if (updateData.contains("fillLevel") && updateData["fillLevel"].is_number()) {
-                    it->fillLevel = std::max(0, std::min(100, updateData["fillLevel"].get<int>()));
+                    it.setFillLevel(std::max(0, std::min(100, updateData["fillLevel"].get<int>())));
+                    changed["fillLevel"] = it.fillLevel();
                 }
 
                 if (updateData.contains("needsCollection") && updateData["needsCollection"].is_boolean()) {
-                    it->needsCollection = updateData["needsCollection"].get<bool>();
+                    it.setNeedsCollection(updateData["needsCollection"].get<bool>());
+                    changed["needsCollection"] = it.needsCollection();
                 }
 
                 // Always update timestamp
-                it->lastUpdated = WasteBin().lastUpdated;  // Use default constructor to get current time
+                it.setLastUpdated(timestamp);
+
+                it.appendJson(updatedJson);
+                shard.journal(journalUpdateRecord(it, changed));
+                return true;
+            });
 
-                saveBinsToFile();
+            if (updated) {
+                if (!commitMutation(req, ticket, res)) {
+                    return;
+                }
 
                 res.set_content(
-                    createApiResponse(true, "Bin with ID " + std::to_string(binId) + " updated successfully", it->toJson()).dump(),
+                    createApiResponse(true, "Bin with ID " + std::to_string(binId) + " updated successfully",
+                                      [&updatedJson](std::string& out) { out += updatedJson; }),
                     "application/json"
                 );
                 return;
@@ -349,65 +7822,180 @@ int main() {
 
             res.status = 404;
             res.set_content(
-                createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found").dump(),
+                createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found"),
                 "application/json"
             );
         }
         catch (const std::exception& e) {
             res.status = 400;
             res.set_content(
-                createApiResponse(false, std::string("Error: ") + e.what()).dump(),
+                createApiResponse(false, std::string("Error: ") + e.what()),
                 "application/json"
             );
         }
     });
 
     // Collect sensor data
-    svr.Post("/bins/collect-sensor-data", [](const httplib::Request&, httplib::Response& res) {
-        if (g_bins.empty()) {
+    svr.Post("/bins/collect-sensor-data", [](const httplib::Request& req, httplib::Response& res) {
+        if (refuseWrites(res)) {
+            return;
+        }
+
+        // Random number generator, one stream per shard
+        std::random_device rd;
+        const unsigned seed = rd();
+
+        // Update every shard in parallel, each under its own lock
+        std::vector<std::vector<WasteBin>> updated(g_store.shardCount());
+        std::vector<CommitTicket> tickets(g_store.shardCount());
+        g_store.parallelForShards([&](size_t index) {
+            std::mt19937 gen(seed + static_cast<unsigned>(index));
+            std::uniform_int_distribution<> distrib(0, 100);
+
+            g_store.write(index, tickets[index], [&](ShardWriter& shard) {
+                std::vector<json> records;
+                records.reserve(shard.size());
+
+                const int64_t now = currentTimeMillis();
+                shard.forEach([&](BinTable::RowRef bin) {
+                    bin.setFillLevel(distrib(gen));
+                    bin.setNeedsCollection(bin.fillLevel() >= COLLECTION_THRESHOLD);
+                    bin.setLastUpdated(now);
+                    updated[index].push_back(bin.toBin());
+                    records.push_back(journalUpdateRecord(bin, {
+                        {"fillLevel", bin.fillLevel()},
+                        {"needsCollection", bin.needsCollection()}
+                    }));
+                });
+
+                shard.journal(records);
+            });
+        });
+
+        // Merge the shards back into id (insertion) order
+        std::vector<WasteBin> merged;
+        for (auto& shard : updated) {
+            std::move(shard.begin(), shard.end(), std::back_inserter(merged));
+        }
+
+        if (merged.empty()) {
             res.status = 404;
             res.set_content(
-                createApiResponse(false, "No bins available").dump(),
+                createApiResponse(false, "No bins available"),
                 "application/json"
             );
             return;
         }
 
-        // Random number generator
-        std::random_device rd;
-        std::mt19937 gen(rd());
-        std::uniform_int_distribution<> distrib(0, 100);
+        CommitTicket ticket;
+        for (const auto& shardTicket : tickets) {
+            ticket.segments.insert(ticket.segments.end(), shardTicket.segments.begin(), shardTicket.segments.end());
+        }
+        if (!commitMutation(req, ticket, res)) {
+            return;
+        }
+
+        std::sort(merged.begin(), merged.end(), [](const WasteBin& a, const WasteBin& b) {
+            return a.id < b.id;
+        });
+
+        res.set_content(
+            createApiResponse(true, "Sensor data collected and updated",
+                              [&merged](std::string& out) { appendBinArray(out, merged); }),
+            "application/json"
+        );
+    });
+
+    // Bulk sensor ingest: apply a batch of gateway readings
+    // ({"binId", "fillLevel", "sensorTimestamp"}) with one journal append per
+    // shard. needsCollection is recomputed from the fill level; a reading
+    // older than the bin's last update is reported stale and not applied,
+    // one stamped more than MAX_SENSOR_CLOCK_SKEW_MS ahead is invalid.
+    svr.Post("/bins/readings", [](const httplib::Request& req, httplib::Response& res) {
+        if (refuseWrites(res)) {
+            return;
+        }
+
+        std::vector<SensorReading> readings;
+        try {
+            json body = json::parse(req.body);
+            const json& items = body.is_object() && body.contains("readings") ? body["readings"] : body;
+            if (!items.is_array()) {
+                throw std::invalid_argument("expected an array of readings");
+            }
+            if (items.size() > MAX_READINGS_PER_REQUEST) {
+                throw std::invalid_argument("at most " + std::to_string(MAX_READINGS_PER_REQUEST) + " readings per request");
+            }
 
-        json updatedBins = json::array();
+            const int64_t now = currentTimeMillis();
+            readings.reserve(items.size());
+            for (const auto& item : items) {
+                readings.push_back(SensorReading::parse(item, now));
+            }
+        }
+        catch (const std::exception& e) {
+            res.status = 400;
+            res.set_content(
+                createApiResponse(false, std::string("Error: ") + e.what()),
+                "application/json"
+            );
+            return;
+        }
 
-        for (auto& bin : g_bins) {
-            bin.fillLevel = distrib(gen);
-            bin.needsCollection = bin.fillLevel >= 75;
-            bin.lastUpdated = WasteBin().lastUpdated;  // Current timestamp
-            updatedBins.push_back(bin.toJson());
+        CommitTicket ticket;
+        applySensorReadings(readings, ticket);
+        if (!commitMutation(req, ticket, res)) {
+            return;
         }
 
-        saveBinsToFile();
+        size_t applied = 0;
+        for (const auto& reading : readings) {
+            applied += reading.status == SensorReading::UPDATED;
+        }
 
         res.set_content(
-            createApiResponse(true, "Sensor data collected and updated", updatedBins).dump(),
+            createApiResponse(true, "Applied " + std::to_string(applied) + " of " + std::to_string(readings.size()) + " readings",
+                              [&](std::string& out) {
+                out += "{\"applied\":";
+                appendJsonInt(out, applied);
+                out += ",\"results\":[";
+                for (size_t i = 0; i < readings.size(); i++) {
+                    if (i > 0) out += ',';
+                    readings[i].appendJson(out);
+                }
+                out += "],\"skipped\":";
+                appendJsonInt(out, readings.size() - applied);
+                out += '}';
+            }),
             "application/json"
         );
     });
 
     // Optimize collection route
     svr.Get("/optimize-route", [](const httplib::Request&, httplib::Response& res) {
-        std::vector<WasteBin> toCollect;
+        std::vector<WasteBin> toCollect = g_store.read([](const BinSnapshot& bins) {
+            // Filter every shard in parallel, then merge
+            std::vector<std::vector<WasteBin>> perShard(bins.shardCount());
+            g_store.parallelForShards([&](size_t shard) {
+                for (const auto& page : bins.shard(shard).pages) {
+                    if (page != nullptr) {
+                        forEachFillMatch(*page, 0, 100, 1, [&](const BinTable::Row& bin) {
+                            perShard[shard].push_back(bin.toBin());
+                        });
+                    }
+                }
+            });
 
-        for (const auto& bin : g_bins) {
-            if (bin.needsCollection) {
-                toCollect.push_back(bin);
+            std::vector<WasteBin> result;
+            for (auto& shard : perShard) {
+                std::move(shard.begin(), shard.end(), std::back_inserter(result));
             }
-        }
+            return result;
+        });
 
         if (toCollect.empty()) {
             res.set_content(
-                createApiResponse(true, "No bins need collection right now", json::array()).dump(),
+                createApiResponse(true, "No bins need collection right now", json::array()),
                 "application/json"
             );
             return;
@@ -419,30 +8007,54 @@ int main() {
         });
 
         // Prepare route data
-        json routeJson = json::array();
-        for (const auto& bin : toCollect) {
-            routeJson.push_back({
-                {"id", bin.id},
-                {"location", bin.location},
-                {"fillLevel", bin.fillLevel},
-                {"lastUpdated", bin.lastUpdated}
-            });
-        }
-
-        json responseData = {
-            {"binsToCollect", toCollect.size()},
-            {"route", routeJson}
+        auto writeRoute = [&toCollect](std::string& out) {
+            out += "{\"binsToCollect\":";
+            appendJsonInt(out, toCollect.size());
+            out += ",\"route\":";
+            appendBinArray(out, toCollect, WasteBin::ALL_FIELDS & ~WasteBin::FIELD_NEEDS_COLLECTION);
+            out += '}';
         };
 
         res.set_content(
-            createApiResponse(true, "Found " + std::to_string(toCollect.size()) + " bins needing collection", responseData).dump(),
+            createApiResponse(true, "Found " + std::to_string(toCollect.size()) + " bins needing collection", writeRoute),
             "application/json"
         );
     });
 
     // Dashboard statistics
-    svr.Get("/dashboard/stats", [](const httplib::Request&, httplib::Response& res) {
-        if (g_bins.empty()) {
+    // SMWS_VERIFY_STATS=1 cross-checks the maintained aggregates against a
+    // full recompute on every request (debugging aid; scans all bins)
+    const bool verifyStats = getEnvInt("SMWS_VERIFY_STATS", 0) != 0;
+    svr.Get("/dashboard/stats", [verifyStats](const httplib::Request&, httplib::Response& res) {
+        // Statistics are maintained by the writers; summing the shards is O(1)
+        ShardAggregates c = g_store.read([verifyStats](const BinSnapshot& bins) {
+            ShardAggregates maintained = bins.aggregates();
+            if (verifyStats) {
+                std::vector<ShardAggregates> perShard(bins.shardCount());
+                g_store.parallelForShards([&](size_t shard) {
+                    for (const auto& page : bins.shard(shard).pages) {
+                        if (page != nullptr) {
+                            perShard[shard] += aggregateTable(*page);
+                        }
+                    }
+                });
+
+                ShardAggregates recomputed;
+                for (const auto& shard : perShard) {
+                    recomputed += shard;
+                }
+                if (!(recomputed == maintained)) {
+                    std::cerr << "Dashboard stats mismatch: maintained " << maintained.bins << " bins, fill "
+                              << maintained.fillSum << ", collect " << maintained.needsCollection
+                              << "; recomputed " << recomputed.bins << " bins, fill " << recomputed.fillSum
+                              << ", collect " << recomputed.needsCollection << std::endl;
+                    return recomputed;
+                }
+            }
+            return maintained;
+        });
+
+        if (c.bins == 0) {
             json emptyStats = {
                 {"totalBins", 0},
                 {"binsNeedingCollection", 0},
@@ -456,80 +8068,323 @@ int main() {
             };
 
             res.set_content(
-                createApiResponse(true, "No bins available", emptyStats).dump(),
+                createApiResponse(true, "No bins available", emptyStats),
                 "application/json"
             );
             return;
         }
 
-        // Calculate statistics
-        int totalBins = g_bins.size();
-        int binsNeedingCollection = 0;
-        int totalFill = 0;
-
-        // Fill level distribution
-        int lowCount = 0;
-        int mediumCount = 0;
-        int highCount = 0;
-        int criticalCount = 0;
-
-        for (const auto& bin : g_bins) {
-            totalFill += bin.fillLevel;
-            if (bin.needsCollection) binsNeedingCollection++;
-
-            if (bin.fillLevel < 25) lowCount++;
-            else if (bin.fillLevel < 50) mediumCount++;
-            else if (bin.fillLevel < 75) highCount++;
-            else criticalCount++;
-        }
-
-        double averageFill = totalBins > 0 ? static_cast<double>(totalFill) / totalBins : 0.0;
+        double averageFill = c.bins > 0 ? static_cast<double>(c.fillSum) / c.bins : 0.0;
 
         json stats = {
-            {"totalBins", totalBins},
-            {"binsNeedingCollection", binsNeedingCollection},
+            {"totalBins", c.bins},
+            {"binsNeedingCollection", c.needsCollection},
             {"averageFillLevel", round(averageFill * 10) / 10.0},  // Round to 1 decimal place
             {"fillLevelDistribution", {
-                {"low", lowCount},
-                {"medium", mediumCount},
-                {"high", highCount},
-                {"critical", criticalCount}
+                {"low", c.fillBuckets[ShardAggregates::FILL_LOW]},
+                {"medium", c.fillBuckets[ShardAggregates::FILL_MEDIUM]},
+                {"high", c.fillBuckets[ShardAggregates::FILL_HIGH]},
+                {"critical", c.fillBuckets[ShardAggregates::FILL_CRITICAL]}
             }}
         };
 
         res.set_content(
-            createApiResponse(true, "Dashboard statistics retrieved successfully", stats).dump(),
+            createApiResponse(true, "Dashboard statistics retrieved successfully", stats),
             "application/json"
         );
     });
 
+    // Fill-level rollups per district (or one bin) per hour or day, served
+    // from the maintained rollup tables:
+    //   resolution=hour|day (default day), district=<name> or binId=<id>
+    //   (default: every district), from=<iso>, to=<iso>
+    svr.Get("/dashboard/rollups", [](const httplib::Request& req, httplib::Response& res) {
+        auto fail = [&res](const std::string& message) {
+            res.status = 400;
+            res.set_content(createApiResponse(false, message), "application/json");
+        };
+
+        FillRollups::Resolution resolution = FillRollups::DAY;
+        if (req.has_param("resolution")) {
+            const std::string value = req.get_param_value("resolution");
+            if (value == "hour") {
+                resolution = FillRollups::HOUR;
+            } else if (value != "day") {
+                fail("Invalid resolution: " + value);
+                return;
+            }
+        }
+
+        // Periods overlapping [from, to)
+        int32_t fromPeriod = INT32_MIN;
+        int32_t toPeriod = INT32_MAX;
+        for (const char* name : {"from", "to"}) {
+            if (!req.has_param(name)) {
+                continue;
+            }
+            const std::string value = req.get_param_value(name);
+            int64_t millis;
+            if (!parseTimestamp(value, millis)) {
+                fail(std::string("Invalid ") + name + ": " + value);
+                return;
+            }
+            if (std::string(name) == "from") {
+                fromPeriod = FillRollups::periodOf(millis, resolution);
+            } else {
+                toPeriod = FillRollups::periodOf(millis - 1, resolution) + 1;
+            }
+        }
+
+        int binId = 0;
+        if (req.has_param("binId")) {
+            const std::string value = req.get_param_value("binId");
+            try {
+                size_t used = 0;
+                binId = std::stoi(value, &used);
+                if (used != value.size()) {
+                    throw std::invalid_argument(value);
+                }
+            } catch (const std::exception&) {
+                fail("Invalid binId: " + value);
+                return;
+            }
+            if (!g_store.read([binId](const BinSnapshot& bins) { return static_cast<bool>(bins.find(binId)); })) {
+                res.status = 404;
+                res.set_content(
+                    createApiResponse(false, "Bin with ID " + std::to_string(binId) + " not found"),
+                    "application/json"
+                );
+                return;
+            }
+        }
+
+        // Merge one owner's cells across the shards that may hold them
+        auto periods = [&](const int* bin, const std::string* district) {
+            std::map<int32_t, FillRollups::DistrictCell> merged;
+            if (bin != nullptr) {
+                g_store.rollups(g_store.shardForId(*bin)).collect(bin, nullptr, resolution, fromPeriod, toPeriod, merged);
+            } else {
+                for (size_t i = 0; i < g_store.shardCount(); i++) {
+                    g_store.rollups(i).collect(nullptr, district, resolution, fromPeriod, toPeriod, merged);
+                }
+            }
+
+            json items = json::array();
+            for (const auto& entry : merged) {
+                const FillRollups::DistrictCell& cell = entry.second;
+                double average = static_cast<double>(cell.sum) / cell.count;
+                items.push_back({
+                    {"start", formatTimestamp(FillRollups::periodStart(entry.first, resolution))},
+                    {"count", cell.count},
+                    {"min", cell.min},
+                    {"max", cell.max},
+                    {"avg", round(average * 10) / 10.0}  // Round to 1 decimal place
+                });
+            }
+            return items;
+        };
+
+        json data = {{"resolution", resolution == FillRollups::HOUR ? "hour" : "day"}};
+        std::string message;
+        if (req.has_param("binId")) {
+            data["binId"] = binId;
+            data["periods"] = periods(&binId, nullptr);
+            message = "Rollups for bin " + std::to_string(binId);
+        } else if (req.has_param("district")) {
+            const std::string district = req.get_param_value("district");
+            data["district"] = district;
+            data["periods"] = periods(nullptr, &district);
+            message = "Rollups for district " + district;
+        } else {
+            std::set<std::string> names;
+            for (size_t i = 0; i < g_store.shardCount(); i++) {
+                g_store.rollups(i).districtNames(names);
+            }
+            json districts = json::array();
+            for (const std::string& name : names) {
+                json items = periods(nullptr, &name);
+                if (!items.empty()) {
+                    districts.push_back({{"district", name}, {"periods", std::move(items)}});
+                }
+            }
+            message = "Rollups for " + std::to_string(districts.size()) + " districts";
+            data["districts"] = std::move(districts);
+        }
+
+        res.set_content(createApiResponse(true, message, data), "application/json");
+    });
+
     // Admin: Load data from file
     svr.Post("/admin/load-data", [](const httplib::Request&, httplib::Response& res) {
-        loadBinsFromFile();
+        if (refuseWrites(res)) {
+            return;
+        }
+
+        // The reload replaces the rollups too; save them first so the
+        // readings already counted are not added twice
+        std::vector<ReplayedReading> replayed;
+        if (!saveRollups() || !loadBinsFromFile(&replayed)) {
+            res.status = 500;
+            res.set_content(
+                createApiResponse(false, "Failed to load bins from file; current data kept"),
+                "application/json"
+            );
+            return;
+        }
+        if (!loadRollups(replayed)) {
+            res.status = 500;
+            res.set_content(
+                createApiResponse(false, "Loaded bins from file but could not load the rollups"),
+                "application/json"
+            );
+            return;
+        }
 
         res.set_content(
-            createApiResponse(true, "Successfully loaded " + std::to_string(g_bins.size()) + " bins from file").dump(),
+            createApiResponse(true, "Successfully loaded " + std::to_string(g_store.size()) + " bins from file"),
             "application/json"
         );
     });
 
     // Admin: Save data to file
     svr.Post("/admin/save-data", [](const httplib::Request&, httplib::Response& res) {
-        saveBinsToFile();
+        if (!saveBinsToFile()) {
+            res.status = 500;
+            res.set_content(
+                createApiResponse(false, "Failed to save bins to file"),
+                "application/json"
+            );
+            return;
+        }
+
+        res.set_content(
+            createApiResponse(true, "Successfully saved " + std::to_string(g_store.size()) + " bins to file"),
+            "application/json"
+        );
+    });
+
+    // Admin: Export bins to the JSON data file
+    svr.Post("/admin/export-data", [](const httplib::Request&, httplib::Response& res) {
+        if (!exportBinsToJson()) {
+            res.status = 500;
+            res.set_content(
+                createApiResponse(false, "Failed to export bins to " + DATA_FILE),
+                "application/json"
+            );
+            return;
+        }
+
+        res.set_content(
+            createApiResponse(true, "Successfully exported bins to " + DATA_FILE),
+            "application/json"
+        );
+    });
+
+    // Admin: Replace all bins with the JSON data file
+    svr.Post("/admin/import-data", [](const httplib::Request&, httplib::Response& res) {
+        if (refuseWrites(res)) {
+            return;
+        }
+
+        JsonImport report;
+        bool imported = importBinsFromJson(report);
+        json summary = {
+            {"imported", report.imported},
+            {"skipped", report.skipped},
+            {"errors", report.errors}
+        };
+        if (!imported) {
+            summary["failure"] = report.failure.empty() ? "could not write the imported bins" : report.failure;
+            res.status = 500;
+            res.set_content(
+                createApiResponse(false, "Failed to import bins from " + DATA_FILE + "; current data kept", summary),
+                "application/json"
+            );
+            return;
+        }
+
+        res.set_content(
+            createApiResponse(true, "Successfully imported " + std::to_string(g_store.size()) + " bins from " + DATA_FILE, summary),
+            "application/json"
+        );
+    });
+
+    // Admin: Memory used by interned locations, and what the same bins would
+    // cost with a std::string per bin
+    svr.Get("/admin/memory", [](const httplib::Request&, httplib::Response& res) {
+        size_t bins = 0;
+        size_t ownedBytes = 0;
+        g_store.read([&](const BinSnapshot& snapshot) {
+            snapshot.forEach([&](const BinTable::Row& bin) {
+                const size_t length = bin.location().size();
+                bins++;
+                // Strings past the small-string buffer own a heap block
+                ownedBytes += sizeof(std::string) + (length >= sizeof(std::string) / 2 ? length + 1 : 0);
+            });
+        });
+
+        const LocationPool::Usage usage = g_locations.usage();
+        const size_t internedBytes = bins * sizeof(uint32_t) + usage.arenaBytes + usage.indexBytes;
+        json memory = {
+            {"bins", bins},
+            {"uniqueLocations", usage.uniqueStrings},
+            {"locationBytes", usage.stringBytes},
+            {"arenaBytes", usage.arenaBytes},
+            {"indexBytes", usage.indexBytes},
+            {"handleBytes", bins * sizeof(uint32_t)},
+            {"perBinStringBytes", ownedBytes},
+            {"bytesSaved", static_cast<int64_t>(ownedBytes) - static_cast<int64_t>(internedBytes)}
+        };
+
+        const FillHistory::Usage history = g_store.historyUsage();
+        const HistoryArchive::Usage archive = g_historyArchive.usage();
+        memory["history"] = {
+            {"bins", history.bins},
+            {"samples", history.samples},
+            {"bytes", history.bytes},
+            {"archivedBlocks", archive.blocks},
+            {"archiveBytes", archive.bytes}
+        };
+
+        FillRollups::Usage rollups;
+        for (size_t i = 0; i < g_store.shardCount(); i++) {
+            FillRollups::Usage usage = g_store.rollups(i).usage();
+            rollups.bins += usage.bins;
+            rollups.bytes += usage.bytes;
+        }
+        memory["rollups"] = {
+            {"bins", rollups.bins},
+            {"bytes", rollups.bytes}
+        };
+
+        res.set_content(
+            createApiResponse(true, "Location memory usage", memory),
+            "application/json"
+        );
+    });
+
+    // Binary ingest listener status and per-connection counters
+    svr.Get("/admin/ingest", [&ingest](const httplib::Request&, httplib::Response& res) {
+        if (!ingest.running()) {
+            res.status = 404;
+            res.set_content(
+                createApiResponse(false, "Binary ingest is disabled (set SMWS_INGEST_PORT)"),
+                "application/json"
+            );
+            return;
+        }
 
         res.set_content(
-            createApiResponse(true, "Successfully saved " + std::to_string(g_bins.size()) + " bins to file").dump(),
+            createApiResponse(true, "Binary ingest status", ingest.status()),
             "application/json"
         );
     });
 
     // Health check
     svr.Get("/health", [](const httplib::Request&, httplib::Response& res) {
-        WasteBin tmp;  // Just to get current timestamp
-
         json health = {
             {"status", "ok"},
-            {"timestamp", tmp.lastUpdated},
+            {"timestamp", formatTimestamp(currentTimeMillis())},
             {"version", "1.0.0"}
         };
 
@@ -552,5 +8407,11 @@ int main() {
     std::cout << "Smart Waste Management API server started on http://0.0.0.0:8080" << std::endl;
     svr.listen("0.0.0.0", 8080);
 
+    ingest.stop();
+    g_store.sealHistory();
+    g_historyArchive.flush();
+    saveRollups();
+    compactor.stop();
+    g_flusher.stop();
     return 0;
 }